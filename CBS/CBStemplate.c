@@ -8,6 +8,32 @@
 #define MAX_COLS 20
 #define MAX_STEPS 100
 
+// High-level heuristics used to order CT nodes
+#define HEURISTIC_NONE 0 // sum of costs only
+#define HEURISTIC_CG 1   // minimum vertex cover of the cardinal conflict graph
+#define HEURISTIC_DG 2   // minimum vertex cover of the pairwise dependency graph
+#define HEURISTIC_WDG 3  // edge-weighted minimum vertex cover of the weighted dependency graph
+#define CBS_HEURISTIC HEURISTIC_CG
+
+// How a conflict is split into two CT children
+#define SPLIT_STANDARD 0 // each child forbids one of the two agents
+#define SPLIT_DISJOINT 1 // one child forbids an agent, the other forces it there
+#define CBS_SPLITTING SPLIT_DISJOINT
+
+// k-robust planning: two agents may not use the same cell within ROBUST_K steps of each other,
+// so the plan survives any agent falling up to ROBUST_K steps behind (0 is standard CBS)
+#define ROBUST_K 0
+
+#define MAX_CT_NODES 200000 // Give up after generating this many CT nodes
+#define PAIR_CT_NODES 64    // Node budget of the two-agent CBS that weighs DG/WDG edges
+#define WDG_SEARCH_LIMIT 100000 // Branching budget of the weighted vertex cover search
+#define CT_MEMORY_LIMIT (512UL << 20) // Hard cap on bytes held by CT nodes
+#define CT_MEMORY_FALLBACK (CT_MEMORY_LIMIT / 10 * 9) // Switch to iterative deepening above this
+
+// Bits stored in the constraint table for one step and cell
+#define VERTEX_CONSTRAINT 1
+#define EDGE_CONSTRAINT(dir) (2 << (dir)) // Entering the cell with move `dir` is forbidden
+
 
 // Direction vectors: up, down, left, right, wait
 int dRow[] = {-1, 1, 0, 0, 0};
@@ -25,6 +51,7 @@ typedef struct Node {
     struct Node* parent;
     int agent_id;
     int step;
+    int conflicts; // Steps so far that run into other agents' paths, to break f ties
 } Node;
 
 // Grid structure
@@ -38,14 +65,76 @@ typedef struct {
     Position start, goal;
     Position path[MAX_STEPS];
     int path_length;
+    int cost; // Step at which the agent reaches its goal and stays there
 } Agent;
 
+// A constraint forbids one agent from a cell, or from one move into it, at a step.
+// A positive constraint instead forces the agent there and forbids it to everyone else.
+typedef struct {
+    int agent; // -1 when the CT node adds no constraint
+    int step;
+    Position pos;
+    int dir; // -1 for a vertex constraint, otherwise the move index into pos
+    int positive;
+    int range; // A vertex constraint covers steps step - range .. step + range
+} Constraint;
+
+// A conflict between two agents in a CT node's solution
+typedef struct {
+    int a1, a2;
+    int step;              // Step of a1
+    int step2;             // Step of a2; differs from step only in k-robust conflicts
+    Position pos1, pos2;   // Cells of a1 at step and a2 at step2
+    Position prev1, prev2; // Cells of a1 and a2 at step - 1
+    int is_edge;           // Swap conflict
+    int cardinal1, cardinal2; // Every optimal path of that agent uses the conflicting cell or move
+    int cardinality;       // 2 cardinal, 1 semi-cardinal, 0 non-cardinal
+} Conflict;
+
+// A path replanned in one CT node, stored as cell ids up to goal arrival together with the
+// MDD singletons of that cost. The agent stays on its last cell afterwards.
+typedef struct PathDelta {
+    struct PathDelta* next; // Other paths replanned in the same CT node
+    int agent;
+    int cost;
+    short* cells; // cost + 1 entries
+    short* mdd;   // cost + 1 entries, -1 where the MDD is wider than one cell
+} PathDelta;
+
+// Full view of a node's solution and pairwise state, kept only while it is on the frontier
+typedef struct {
+    const PathDelta** paths;   // Newest path of every agent on the branch
+    unsigned int* conflicting; // Colliding pairs as bitmasks
+    unsigned char* weight;     // num_agents x num_agents edge weights of the heuristic graph
+} CTCache;
+
+// Constraint tree node: one constraint added to its parent and the paths it replanned
+typedef struct CTNode {
+    struct CTNode* parent;
+    struct CTNode *next_alloc, *prev_alloc; // Every node of one search, for freeing
+    Constraint constraint;
+    int cost;           // Sum of costs
+    int h;              // High-level heuristic
+    int conflict_pairs; // Number of agent pairs whose paths collide
+    PathDelta* deltas;
+    CTCache* cache;
+} CTNode;
+
+// Counters reported by a constraint tree search
+typedef struct {
+    int expanded, generated;
+    int iterative_deepening; // Switched to iterative deepening near the memory cap
+    int aborted;             // Ran into the node limit or the hard memory cap
+} CTStats;
+
 Grid grid;
 Agent agents[MAX_AGENTS];
 int num_agents = 0;
 
 // Constraints prevent agents from being at certain positions at specific times
 int constraints[MAX_AGENTS][MAX_STEPS][MAX_ROWS][MAX_COLS];
+// Cell each agent is forced to occupy at a step by positive constraints (-1 if none)
+short landmarks[MAX_AGENTS][MAX_STEPS];
 
 // Prints the grid with agent starts and goals
 void print_grid() {
@@ -83,29 +172,74 @@ int has_conflict(Position a_pos, int a_step, Position b_pos, int b_step, Positio
     return 0;
 }
 
+// Index of the move that leads from one cell to a neighbouring one
+int move_index(Position from, Position to) {
+    for (int i = 0; i < 5; i++)
+        if (from.row + dRow[i] == to.row && from.col + dCol[i] == to.col)
+            return i;
+    return -1;
+}
+
+// Cell number used in MDD layers
+short cell_id(Position p) {
+    return (short)(p.row * MAX_COLS + p.col);
+}
+
+// Steps within ROBUST_K of which another agent of the replanned node is on each cell, stamped
+// with avoid_id: among paths of equal cost, A* prefers the one that runs into fewer of them
+static int avoid[MAX_STEPS][MAX_ROWS][MAX_COLS];
+static int avoid_id = 0;
+
 // Performs A* pathfinding with temporal constraints
-Node* a_star_search(int agent_id, int local_constraints[MAX_STEPS][MAX_ROWS][MAX_COLS]) {
-    Node* open_list[MAX_ROWS * MAX_COLS * MAX_STEPS];
+int a_star_search(int agent_id, int local_constraints[MAX_STEPS][MAX_ROWS][MAX_COLS]) {
+    static Node* open_list[MAX_ROWS * MAX_COLS * MAX_STEPS];
     int open_size = 0;
-    Node* closed_list[MAX_ROWS * MAX_COLS * MAX_STEPS];
+    static Node* closed_list[MAX_ROWS * MAX_COLS * MAX_STEPS];
     int closed_size = 0;
+    // Every move costs one step, so a (cell, step) state is only worth generating once
+    static int generated[MAX_STEPS][MAX_ROWS][MAX_COLS];
+    static int search_id = 0;
+    search_id++;
+
+    // The agent may only stay at its goal after the last step it is forbidden there
+    // or has to be somewhere else
+    Position goal = agents[agent_id].goal;
+    short* landmark = landmarks[agent_id];
+    Position start = agents[agent_id].start;
+    // Range constraints may reach back to the start
+    if ((local_constraints[0][start.row][start.col] & VERTEX_CONSTRAINT) ||
+        (landmark[0] >= 0 && landmark[0] != cell_id(start)))
+        return 0;
+    int last_block = -1;
+    for (int t = MAX_STEPS - 1; t >= 0; t--) {
+        if ((local_constraints[t][goal.row][goal.col] & VERTEX_CONSTRAINT) ||
+            (landmark[t] >= 0 && landmark[t] != cell_id(goal))) {
+            last_block = t;
+            break;
+        }
+    }
 
     // Initialize start node
     Node* start_node = (Node*)malloc(sizeof(Node));
     start_node->pos = agents[agent_id].start;
     start_node->g_cost = 0;
-    start_node->h_cost = manhattan_distance(start_node->pos, agents[agent_id].goal);
+    start_node->h_cost = manhattan_distance(start_node->pos, goal);
     start_node->f_cost = start_node->g_cost + start_node->h_cost;
     start_node->parent = NULL;
     start_node->step = 0;
+    start_node->conflicts = 0;
 
     open_list[open_size++] = start_node;
+    generated[0][start_node->pos.row][start_node->pos.col] = search_id;
+    int found = 0;
 
     while (open_size > 0) {
         // Find node with lowest f_cost
         int best_index = 0;
         for (int i = 1; i < open_size; i++) {
-            if (open_list[i]->f_cost < open_list[best_index]->f_cost)
+            if (open_list[i]->f_cost < open_list[best_index]->f_cost ||
+                (open_list[i]->f_cost == open_list[best_index]->f_cost &&
+                 open_list[i]->conflicts < open_list[best_index]->conflicts))
                 best_index = i;
         }
         Node* current = open_list[best_index];
@@ -116,8 +250,8 @@ Node* a_star_search(int agent_id, int local_constraints[MAX_STEPS][MAX_ROWS][MAX
         closed_list[closed_size++] = current;
 
         // If goal reached, reconstruct and store path
-        if (current->pos.row == agents[agent_id].goal.row &&
-            current->pos.col == agents[agent_id].goal.col) {
+        if (current->pos.row == goal.row && current->pos.col == goal.col &&
+            current->step > last_block) {
             Node* path_node = current;
             int len = 0;
             while (path_node != NULL) {
@@ -125,6 +259,7 @@ Node* a_star_search(int agent_id, int local_constraints[MAX_STEPS][MAX_ROWS][MAX
                 path_node = path_node->parent;
             }
             agents[agent_id].path_length = len;
+            agents[agent_id].cost = current->step;
             path_node = current;
             for (int i = len - 1; i >= 0; i--) {
                 agents[agent_id].path[i] = path_node->pos;
@@ -132,53 +267,774 @@ Node* a_star_search(int agent_id, int local_constraints[MAX_STEPS][MAX_ROWS][MAX
             }
             // Extend path with goal to prevent reoccupying
             for (int i = agents[agent_id].path_length; i < MAX_STEPS; i++) {
-                agents[agent_id].path[i] = agents[agent_id].goal;
+                agents[agent_id].path[i] = goal;
             }
             agents[agent_id].path_length = MAX_STEPS;
-            return current;
+            found = 1;
+            break;
         }
 
         // Try all directions (including wait)
         for (int i = 0; i < 5; i++) {
             Position next_pos = { current->pos.row + dRow[i], current->pos.col + dCol[i] };
-        
+
             if (!is_valid_position(next_pos)) continue;
 
             int step = current->step + 1;
             if (step >= MAX_STEPS) continue;
-            if (local_constraints[step][next_pos.row][next_pos.col]) continue;
-
-            // Check if already visited
-            int in_closed = 0;
-            for (int j = 0; j < closed_size; j++) {
-                if (closed_list[j]->pos.row == next_pos.row &&
-                    closed_list[j]->pos.col == next_pos.col &&
-                    closed_list[j]->step == step) {
-                    in_closed = 1;
-                    break;
-                }
-            }
-            if (in_closed) continue;
+            if (local_constraints[step][next_pos.row][next_pos.col] & (VERTEX_CONSTRAINT | EDGE_CONSTRAINT(i))) continue;
+            if (landmark[step] >= 0 && landmark[step] != cell_id(next_pos)) continue;
+
+            // Check if already generated
+            if (generated[step][next_pos.row][next_pos.col] == search_id) continue;
+            generated[step][next_pos.row][next_pos.col] = search_id;
 
             // Create neighbor node
             Node* neighbor = (Node*)malloc(sizeof(Node));
             neighbor->pos = next_pos;
             neighbor->g_cost = current->g_cost + 1;
-            neighbor->h_cost = manhattan_distance(next_pos, agents[agent_id].goal);
+            neighbor->h_cost = manhattan_distance(next_pos, goal);
             neighbor->f_cost = neighbor->g_cost + neighbor->h_cost;
             neighbor->parent = current;
             neighbor->step = step;
+            neighbor->conflicts = current->conflicts + (avoid[step][next_pos.row][next_pos.col] == avoid_id);
 
             open_list[open_size++] = neighbor;
         }
     }
 
-    return NULL;// Path not found
+    // The CT calls this thousands of times, so release the whole search tree
+    for (int i = 0; i < open_size; i++) free(open_list[i]);
+    for (int i = 0; i < closed_size; i++) free(closed_list[i]);
+    return found;
+}
+
+// Per-step reachability scratch for MDD construction (bit 1 forward, bit 2 on an optimal path)
+static unsigned char mdd_layers[MAX_STEPS][MAX_ROWS][MAX_COLS];
+
+// Builds the MDD of an agent's cost-optimal paths under its constraints and records,
+// for every step, the single cell the MDD passes through (-1 where it is wider)
+void build_mdd(int agent_id, int local_constraints[MAX_STEPS][MAX_ROWS][MAX_COLS], short mdd[MAX_STEPS]) {
+    Agent* a = &agents[agent_id];
+    int cost = a->cost;
+    memset(mdd_layers, 0, sizeof(mdd_layers[0]) * (cost + 1));
+    mdd_layers[0][a->start.row][a->start.col] = 1;
+
+    // Forward pass: cells reachable at each step that can still reach the goal in time
+    for (int t = 0; t < cost; t++) {
+        for (int r = 0; r < grid.rows; r++) {
+            for (int c = 0; c < grid.cols; c++) {
+                if (!(mdd_layers[t][r][c] & 1)) continue;
+                for (int i = 0; i < 5; i++) {
+                    Position next = { r + dRow[i], c + dCol[i] };
+                    if (!is_valid_position(next)) continue;
+                    if (local_constraints[t + 1][next.row][next.col] & (VERTEX_CONSTRAINT | EDGE_CONSTRAINT(i))) continue;
+                    if (landmarks[agent_id][t + 1] >= 0 && landmarks[agent_id][t + 1] != cell_id(next)) continue;
+                    if (t + 1 + manhattan_distance(next, a->goal) > cost) continue;
+                    mdd_layers[t + 1][next.row][next.col] |= 1;
+                }
+            }
+        }
+    }
+
+    // Backward pass: keep only cells on a path that ends at the goal at `cost`
+    for (int t = cost; t < MAX_STEPS; t++)
+        mdd[t] = cell_id(a->goal);
+    mdd_layers[cost][a->goal.row][a->goal.col] |= 2;
+    for (int t = cost - 1; t >= 0; t--) {
+        int width = 0;
+        short only = -1;
+        for (int r = 0; r < grid.rows; r++) {
+            for (int c = 0; c < grid.cols; c++) {
+                if (!(mdd_layers[t][r][c] & 1)) continue;
+                for (int i = 0; i < 5; i++) {
+                    Position next = { r + dRow[i], c + dCol[i] };
+                    if (!is_valid_position(next)) continue;
+                    if (!(mdd_layers[t + 1][next.row][next.col] & 2)) continue;
+                    if (local_constraints[t + 1][next.row][next.col] & EDGE_CONSTRAINT(i)) continue;
+                    mdd_layers[t][r][c] |= 2;
+                    width++;
+                    only = cell_id((Position){r, c});
+                    break;
+                }
+            }
+        }
+        mdd[t] = (width == 1) ? only : -1;
+    }
+}
+
+// Sets or clears one constraint bit in an agent's table
+void mark_constraint(int agent_id, int step, Position pos, int bit, int set) {
+    if (set)
+        constraints[agent_id][step][pos.row][pos.col] |= bit;
+    else
+        constraints[agent_id][step][pos.row][pos.col] &= ~bit;
+}
+
+// Sets or clears, in the agent's constraint table, every constraint on the node's branch.
+// Another agent's positive constraint becomes negative ones for this agent.
+void apply_constraints(const CTNode* node, int agent_id, int set) {
+    for (; node != NULL; node = node->parent) {
+        const Constraint* c = &node->constraint;
+        if (c->agent < 0) continue;
+        Position prev = c->pos;
+        if (c->dir >= 0) {
+            prev.row -= dRow[c->dir];
+            prev.col -= dCol[c->dir];
+        }
+
+        int first = (c->step - c->range > 0) ? c->step - c->range : 0;
+        int last = (c->step + c->range < MAX_STEPS - 1) ? c->step + c->range : MAX_STEPS - 1;
+
+        if (!c->positive) {
+            if (c->agent != agent_id) continue;
+            if (c->dir >= 0)
+                mark_constraint(agent_id, c->step, c->pos, EDGE_CONSTRAINT(c->dir), set);
+            else
+                for (int t = first; t <= last; t++)
+                    mark_constraint(agent_id, t, c->pos, VERTEX_CONSTRAINT, set);
+        } else if (c->agent == agent_id) {
+            landmarks[agent_id][c->step] = set ? cell_id(c->pos) : -1;
+            if (c->dir >= 0) landmarks[agent_id][c->step - 1] = set ? cell_id(prev) : -1;
+        } else {
+            // The cell is taken around that step, and for a move so are its source and the reverse move
+            for (int t = first; t <= last; t++)
+                mark_constraint(agent_id, t, c->pos, VERTEX_CONSTRAINT, set);
+            if (c->dir >= 0) {
+                mark_constraint(agent_id, c->step - 1, prev, VERTEX_CONSTRAINT, set);
+                mark_constraint(agent_id, c->step, prev, EDGE_CONSTRAINT(move_index(c->pos, prev)), set);
+            }
+        }
+    }
+}
+
+// Bytes currently held by CT nodes, their paths and frontier caches
+size_t ct_memory = 0, ct_peak_memory = 0;
+
+void* ct_alloc(size_t size) {
+    ct_memory += size;
+    if (ct_memory > ct_peak_memory) ct_peak_memory = ct_memory;
+    return malloc(size);
+}
+
+void ct_free(void* p, size_t size) {
+    ct_memory -= size;
+    free(p);
+}
+
+// Position of a path at a step; the agent waits at its goal after arriving
+Position path_at(const PathDelta* p, int step) {
+    short id = p->cells[step < p->cost ? step : p->cost];
+    return (Position){ id / MAX_COLS, id % MAX_COLS };
+}
+
+short mdd_at(const PathDelta* p, int step) {
+    return p->mdd[step < p->cost ? step : p->cost];
+}
+
+size_t delta_size(int cost) {
+    return sizeof(PathDelta) + sizeof(short) * 2 * (cost + 1);
+}
+
+size_t cache_size() {
+    return sizeof(CTCache) + sizeof(PathDelta*) * num_agents + sizeof(unsigned int) * num_agents +
+        (size_t)num_agents * num_agents;
+}
+
+// Allocates a frontier cache, copied from the parent's when there is one
+CTCache* new_cache(const CTCache* from) {
+    CTCache* cache = (CTCache*)ct_alloc(cache_size());
+    cache->paths = (const PathDelta**)(cache + 1);
+    cache->conflicting = (unsigned int*)(cache->paths + num_agents);
+    cache->weight = (unsigned char*)(cache->conflicting + num_agents);
+    if (from)
+        memcpy(cache->paths, from->paths, cache_size() - sizeof(CTCache));
+    else
+        memset(cache->paths, 0, cache_size() - sizeof(CTCache));
+    return cache;
+}
+
+void drop_cache(CTNode* node) {
+    if (!node->cache) return;
+    ct_free(node->cache, cache_size());
+    node->cache = NULL;
+}
+
+// Reconstructs a node's full solution by walking parent links to each agent's newest path
+void collect_paths(const CTNode* node, const PathDelta** paths) {
+    int missing = num_agents;
+    memset(paths, 0, sizeof(*paths) * num_agents);
+    for (; node && missing; node = node->parent) {
+        for (const PathDelta* d = node->deltas; d; d = d->next) {
+            if (!paths[d->agent]) {
+                paths[d->agent] = d;
+                missing--;
+            }
+        }
+    }
+}
+
+// Checks whether an agent's path breaks another agent's positive constraint
+int violates_positive(const PathDelta* p, const Constraint* c) {
+    for (int t = (c->step - c->range > 0) ? c->step - c->range : 0; t <= c->step + c->range; t++) {
+        Position near = path_at(p, t);
+        if (near.row == c->pos.row && near.col == c->pos.col) return 1;
+    }
+    if (c->dir < 0) return 0;
+    Position at = path_at(p, c->step);
+    Position prev = { c->pos.row - dRow[c->dir], c->pos.col - dCol[c->dir] };
+    Position before = path_at(p, c->step - 1);
+    if (before.row == prev.row && before.col == prev.col) return 1;
+    return before.row == c->pos.row && before.col == c->pos.col && at.row == prev.row && at.col == prev.col;
+}
+
+// Replans one agent under the constraints on the node's branch and stores the new path
+// and its MDD as a delta against the parent
+int replan_agent(CTNode* node, int agent_id) {
+    static short mdd[MAX_STEPS];
+    avoid_id++;
+    for (int a = 0; a < num_agents; a++) {
+        const PathDelta* p = node->cache->paths[a];
+        if (a == agent_id || !p) continue;
+        for (int t = 0; t < MAX_STEPS; t++) {
+            Position at = path_at(p, t);
+            for (int u = (t - ROBUST_K > 0) ? t - ROBUST_K : 0; u <= t + ROBUST_K && u < MAX_STEPS; u++)
+                avoid[u][at.row][at.col] = avoid_id;
+        }
+    }
+    apply_constraints(node, agent_id, 1);
+    int found = a_star_search(agent_id, constraints[agent_id]);
+    if (found) {
+        build_mdd(agent_id, constraints[agent_id], mdd);
+        int cost = agents[agent_id].cost;
+        PathDelta* d = (PathDelta*)ct_alloc(delta_size(cost));
+        d->agent = agent_id;
+        d->cost = cost;
+        d->cells = (short*)(d + 1);
+        d->mdd = d->cells + cost + 1;
+        for (int t = 0; t <= cost; t++)
+            d->cells[t] = cell_id(agents[agent_id].path[t]);
+        memcpy(d->mdd, mdd, sizeof(short) * (cost + 1));
+        d->next = node->deltas;
+        node->deltas = d;
+
+        const PathDelta* old = node->cache->paths[agent_id];
+        node->cost += cost - (old ? old->cost : 0);
+        node->cache->paths[agent_id] = d;
+    }
+    apply_constraints(node, agent_id, 0);
+    return found;
+}
+
+// Number of set bits in an agent mask
+int count_bits(unsigned int mask) {
+    int n = 0;
+    for (; mask; mask &= mask - 1) n++;
+    return n;
+}
+
+// Number of steps of the second path within ROBUST_K of the current step that use each cell
+static short window_visits[MAX_ROWS * MAX_COLS];
+
+// Finds every conflict between two agents of a node, keeps the most cardinal (then earliest)
+// one in `best`, and returns how many steps conflict. The second path is read through a window
+// of cells it uses within ROBUST_K steps, slid one step at a time, so a step costs O(1) for any k.
+int pair_conflicts(const CTCache* cache, int i, int j, Conflict* best) {
+    const PathDelta* a = cache->paths[i];
+    const PathDelta* b = cache->paths[j];
+    int last = (a->cost > b->cost) ? a->cost : b->cost;
+    if (last > MAX_STEPS - 1) last = MAX_STEPS - 1;
+    int count = 0;
+    best->cardinality = -1;
+
+    for (int t = 0; t < ROBUST_K; t++)
+        window_visits[cell_id(path_at(b, t))]++;
+    int step;
+    for (step = 0; step <= last; step++) {
+        window_visits[cell_id(path_at(b, step + ROBUST_K))]++;
+        if (step - ROBUST_K - 1 >= 0)
+            window_visits[cell_id(path_at(b, step - ROBUST_K - 1))]--;
+
+        Position a_prev = path_at(a, step > 0 ? step - 1 : 0);
+        Position b_prev = path_at(b, step > 0 ? step - 1 : 0);
+        Position a_curr = path_at(a, step);
+        Position b_curr = path_at(b, step);
+        int step2 = step;
+        if (window_visits[cell_id(a_curr)] > 0) {
+            // The second agent's visit to the cell closest in time
+            for (int d = 0; d <= ROBUST_K; d++) {
+                if (step - d >= 0 && cell_id(path_at(b, step - d)) == cell_id(a_curr)) {
+                    step2 = step - d;
+                    break;
+                }
+                if (cell_id(path_at(b, step + d)) == cell_id(a_curr)) {
+                    step2 = step + d;
+                    break;
+                }
+            }
+            b_curr = path_at(b, step2);
+            b_prev = path_at(b, step2 > 0 ? step2 - 1 : 0);
+        } else if (ROBUST_K > 0 || !has_conflict(a_curr, step, b_curr, step, a_prev, b_prev)) {
+            // With k > 0 a swap already puts both agents on one cell one step apart
+            continue;
+        }
+        count++;
+
+        Conflict c;
+        c.a1 = i;
+        c.a2 = j;
+        c.step = step;
+        c.step2 = step2;
+        c.pos1 = a_curr;
+        c.pos2 = b_curr;
+        c.prev1 = a_prev;
+        c.prev2 = b_prev;
+        c.is_edge = !(a_curr.row == b_curr.row && a_curr.col == b_curr.col);
+        // A side is cardinal when every optimal path of that agent uses the conflicting cell or move
+        int s1 = mdd_at(a, step) == cell_id(a_curr);
+        int s2 = mdd_at(b, step2) == cell_id(b_curr);
+        if (c.is_edge) {
+            s1 = s1 && mdd_at(a, step - 1) == cell_id(a_prev);
+            s2 = s2 && mdd_at(b, step - 1) == cell_id(b_prev);
+        }
+        c.cardinal1 = s1;
+        c.cardinal2 = s2;
+        c.cardinality = s1 + s2;
+        if (c.cardinality > best->cardinality) *best = c;
+        if (best->cardinality == 2) break;
+    }
+    // Empty the window for the next pair
+    if (step > last) step = last;
+    for (int t = (step - ROBUST_K > 0) ? step - ROBUST_K : 0; t <= step + ROBUST_K; t++)
+        window_visits[cell_id(path_at(b, t))] = 0;
+    return count;
+}
+
+CTNode* ct_search(CTNode* root, unsigned int mask, int heuristic, int node_limit, CTStats* stats);
+
+// Allocates a CT node as a child of `parent` and links it into the search's node list
+CTNode* new_ct_node(CTNode* parent, CTNode* root) {
+    CTNode* node = (CTNode*)ct_alloc(sizeof(CTNode));
+    memset(node, 0, sizeof(CTNode));
+    node->parent = parent;
+    node->constraint.agent = -1;
+    node->cache = new_cache(parent ? parent->cache : NULL);
+    if (parent) node->cost = parent->cost;
+    if (root) {
+        node->next_alloc = root->next_alloc;
+        node->prev_alloc = root;
+        if (root->next_alloc) root->next_alloc->prev_alloc = node;
+        root->next_alloc = node;
+    }
+    return node;
+}
+
+// Frees a node with its paths and unlinks it from its search's node list
+void free_ct_node(CTNode* node) {
+    if (node->prev_alloc) node->prev_alloc->next_alloc = node->next_alloc;
+    if (node->next_alloc) node->next_alloc->prev_alloc = node->prev_alloc;
+    while (node->deltas) {
+        PathDelta* next = node->deltas->next;
+        ct_free(node->deltas, delta_size(node->deltas->cost));
+        node->deltas = next;
+    }
+    drop_cache(node);
+    ct_free(node, sizeof(CTNode));
+}
+
+// Frees every node created by the search rooted at `root`
+void free_ct_nodes(CTNode* root) {
+    while (root) {
+        CTNode* next = root->next_alloc;
+        root->prev_alloc = root->next_alloc = NULL;
+        free_ct_node(root);
+        root = next;
+    }
+}
+
+// Weight of a dependency-graph edge: the extra cost two agents need to avoid each other,
+// found by a small CBS over just that pair under the node's constraints
+int pair_dependency(CTNode* node, int i, int j, int cardinal) {
+    CTNode* root = new_ct_node(node, NULL);
+    unsigned int pair = (1u << i) | (1u << j);
+    root->cache->conflicting[i] = (1u << j);
+    root->cache->conflicting[j] = (1u << i);
+    root->cache->weight[i * num_agents + j] = root->cache->weight[j * num_agents + i] = (unsigned char)cardinal;
+    root->conflict_pairs = 1;
+    root->h = cardinal;
+
+    CTStats stats = {0};
+    CTNode* goal = ct_search(root, pair, HEURISTIC_CG, PAIR_CT_NODES, &stats);
+    // Out of budget: a cardinal conflict alone still proves one extra step
+    int extra = goal ? goal->cost - node->cost : cardinal;
+    free_ct_nodes(root);
+    return (extra > UCHAR_MAX) ? UCHAR_MAX : extra;
+}
+
+// Refreshes the conflict bits and heuristic edge weight of one pair of agents
+void update_pair(CTNode* node, int i, int j, int heuristic) {
+    CTCache* cache = node->cache;
+    Conflict c;
+    int weight = 0;
+    if (pair_conflicts(cache, i, j, &c)) {
+        cache->conflicting[i] |= (1u << j);
+        cache->conflicting[j] |= (1u << i);
+        if (heuristic == HEURISTIC_CG)
+            weight = (c.cardinality == 2);
+        else if (heuristic == HEURISTIC_DG)
+            weight = pair_dependency(node, i, j, c.cardinality == 2) > 0;
+        else if (heuristic == HEURISTIC_WDG)
+            weight = pair_dependency(node, i, j, c.cardinality == 2);
+    } else {
+        cache->conflicting[i] &= ~(1u << j);
+        cache->conflicting[j] &= ~(1u << i);
+    }
+    cache->weight[i * num_agents + j] = cache->weight[j * num_agents + i] = (unsigned char)weight;
+}
+
+// Decides whether the graph given by adjacency masks has a vertex cover of at most k vertices
+int has_vertex_cover(unsigned int adj[MAX_AGENTS], int k) {
+    int u = -1;
+    for (int i = 0; i < num_agents; i++) {
+        if (adj[i]) {
+            u = i;
+            break;
+        }
+    }
+    if (u < 0) return 1;
+    if (k <= 0) return 0;
+
+    unsigned int saved[MAX_AGENTS];
+    memcpy(saved, adj, sizeof(saved));
+    // Either u is in the cover...
+    for (int v = 0; v < num_agents; v++) adj[v] &= ~(1u << u);
+    adj[u] = 0;
+    int found = has_vertex_cover(adj, k - 1);
+    memcpy(adj, saved, sizeof(saved));
+    if (found) return 1;
+
+    // ...or all of its neighbours are
+    unsigned int neighbours = adj[u];
+    int degree = count_bits(neighbours);
+    if (degree > k) return 0;
+    for (int w = 0; w < num_agents; w++) {
+        if (!(neighbours & (1u << w))) continue;
+        for (int v = 0; v < num_agents; v++) adj[v] &= ~(1u << w);
+        adj[w] = 0;
+    }
+    found = has_vertex_cover(adj, k - degree);
+    memcpy(adj, saved, sizeof(saved));
+    return found;
+}
+
+int edge_weight(const CTCache* cache, int u, int v) {
+    return cache->weight[u * num_agents + v];
+}
+
+// Branch and bound state of the edge-weighted vertex cover search
+static int wdg_best, wdg_budget;
+
+// Assigns a value to each vertex of a component in turn so that x[u] + x[v] >= weight[u][v]
+void weighted_cover(const CTCache* cache, const int* vertices, int count, int index, int* x, int sum) {
+    if (sum >= wdg_best || --wdg_budget < 0) return;
+    if (index == count) {
+        wdg_best = sum;
+        return;
+    }
+    int u = vertices[index];
+    int low = 0, high = 0;
+    for (int k = 0; k < count; k++) {
+        int v = vertices[k];
+        int w = edge_weight(cache, u, v);
+        if (w > high) high = w;
+        if (k < index && w - x[v] > low) low = w - x[v];
+    }
+    for (int value = low; value <= high; value++) {
+        x[u] = value;
+        weighted_cover(cache, vertices, count, index + 1, x, sum + value);
+    }
+}
+
+// Admissible estimate of the extra cost needed to resolve the node's remaining conflicts
+int compute_heuristic(const CTCache* cache, unsigned int mask, int heuristic, int lower) {
+    if (heuristic == HEURISTIC_NONE) return 0;
+
+    unsigned int adj[MAX_AGENTS] = {0};
+    for (int i = 0; i < num_agents; i++) {
+        if (!(mask & (1u << i))) continue;
+        for (int j = 0; j < num_agents; j++)
+            if ((mask & (1u << j)) && edge_weight(cache, i, j))
+                adj[i] |= (1u << j);
+    }
+
+    if (heuristic != HEURISTIC_WDG) {
+        // Minimum vertex cover, searched upwards from the bound inherited from the parent
+        int k = (lower > 0) ? lower : 0;
+        while (!has_vertex_cover(adj, k)) k++;
+        return k;
+    }
+
+    // Edge-weighted vertex cover, solved per connected component
+    int h = 0;
+    unsigned int left = 0;
+    for (int i = 0; i < num_agents; i++)
+        if (adj[i]) left |= (1u << i);
+    while (left) {
+        int vertices[MAX_AGENTS], count = 0;
+        unsigned int frontier = left & (~left + 1);
+        unsigned int component = 0;
+        while (frontier) {
+            int v = 0;
+            while (!(frontier & (1u << v))) v++;
+            frontier &= ~(1u << v);
+            component |= (1u << v);
+            vertices[count++] = v;
+            frontier |= adj[v] & ~component & ~frontier;
+        }
+        left &= ~component;
+
+        // A maximal matching is a lower bound if the search runs out of budget
+        int matching = 0;
+        unsigned int matched = 0;
+        for (int a = 0; a < count; a++) {
+            for (int b = a + 1; b < count; b++) {
+                int u = vertices[a], v = vertices[b];
+                if (edge_weight(cache, u, v) && !(matched & ((1u << u) | (1u << v)))) {
+                    matched |= (1u << u) | (1u << v);
+                    matching += edge_weight(cache, u, v);
+                }
+            }
+        }
+        int x[MAX_AGENTS] = {0};
+        wdg_best = INT_MAX;
+        wdg_budget = WDG_SEARCH_LIMIT;
+        weighted_cover(cache, vertices, count, 0, x, 0);
+        h += (wdg_budget >= 0) ? wdg_best : matching;
+    }
+    return h;
+}
+
+// Recomputes the pairs touching the replanned agents, then the node's conflict count and heuristic
+void refresh_node(CTNode* node, unsigned int replanned, unsigned int mask, int heuristic) {
+    for (int i = 0; i < num_agents; i++) {
+        if (!(replanned & (1u << i))) continue;
+        for (int j = 0; j < num_agents; j++) {
+            if (j == i || !(mask & (1u << j))) continue;
+            // Pairs of two replanned agents are handled once
+            if ((replanned & (1u << j)) && j < i) continue;
+            update_pair(node, i, j, heuristic);
+        }
+    }
+    node->conflict_pairs = 0;
+    for (int i = 0; i < num_agents; i++)
+        if (mask & (1u << i))
+            node->conflict_pairs += count_bits(node->cache->conflicting[i] & mask);
+    node->conflict_pairs /= 2;
+
+    // Only edges at the replanned agents changed, and each can lower the cover by at most one
+    int lower = node->parent ? node->parent->h - count_bits(replanned) : 0;
+    if (heuristic == HEURISTIC_WDG) lower = 0;
+    node->h = compute_heuristic(node->cache, mask, heuristic, lower);
+}
+
+// Picks the conflict to branch on: cardinal before semi-cardinal before non-cardinal
+void choose_conflict(const CTNode* node, unsigned int mask, Conflict* chosen) {
+    chosen->cardinality = -1;
+    for (int i = 0; i < num_agents; i++) {
+        if (!(mask & (1u << i))) continue;
+        for (int j = i + 1; j < num_agents; j++) {
+            if (!(mask & (1u << j)) || !(node->cache->conflicting[i] & (1u << j))) continue;
+            Conflict c;
+            pair_conflicts(node->cache, i, j, &c);
+            if (c.cardinality > chosen->cardinality ||
+                (c.cardinality == chosen->cardinality && c.step < chosen->step))
+                *chosen = c;
+        }
+    }
+}
+
+// Orders the CT open list by f = cost + h, then by fewer conflicting pairs
+int ct_node_before(const CTNode* a, const CTNode* b) {
+    if (a->cost + a->h != b->cost + b->h) return a->cost + a->h < b->cost + b->h;
+    return a->conflict_pairs < b->conflict_pairs;
+}
+
+void ct_heap_push(CTNode*** heap, int* size, int* capacity, CTNode* node) {
+    if (*size == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 64;
+        *heap = (CTNode**)realloc(*heap, sizeof(CTNode*) * *capacity);
+    }
+    int i = (*size)++;
+    while (i > 0 && ct_node_before(node, (*heap)[(i - 1) / 2])) {
+        (*heap)[i] = (*heap)[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    (*heap)[i] = node;
+}
+
+CTNode* ct_heap_pop(CTNode** heap, int* size) {
+    CTNode* top = heap[0];
+    CTNode* last = heap[--(*size)];
+    int i = 0;
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= *size) break;
+        if (child + 1 < *size && ct_node_before(heap[child + 1], heap[child])) child++;
+        if (!ct_node_before(heap[child], last)) break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    if (*size > 0) heap[i] = last;
+    return top;
+}
+
+// Generates the two children of a node for its chosen conflict and returns how many of them
+// have a feasible solution
+int expand_ct_node(CTNode* node, CTNode* root, unsigned int mask, int heuristic, CTNode* children[2], CTStats* stats) {
+    Conflict c;
+    int count = 0;
+    choose_conflict(node, mask, &c);
+    // Disjoint splitting branches on one agent, preferring the side that is cardinal
+    int split_second = c.cardinal2 && !c.cardinal1;
+    for (int side = 0; side < 2; side++) {
+        CTNode* child = new_ct_node(node, root);
+        Constraint* con = &child->constraint;
+        int second = (CBS_SPLITTING == SPLIT_DISJOINT) ? split_second : side;
+        con->agent = second ? c.a2 : c.a1;
+        con->step = second ? c.step2 : c.step;
+        con->pos = second ? c.pos2 : c.pos1;
+        con->dir = c.is_edge ? move_index(second ? c.prev2 : c.prev1, con->pos) : -1;
+        con->positive = (CBS_SPLITTING == SPLIT_DISJOINT) && side == 1;
+        // A k-robust conflict keeps the other agents off the cell for k steps either side of a
+        // forced visit; standard splitting instead keeps each agent off it around the other's
+        // visit, so neither child can meet the same conflict a step earlier or later
+        if (con->positive) {
+            con->range = ROBUST_K;
+        } else if (CBS_SPLITTING == SPLIT_STANDARD) {
+            con->step = second ? c.step : c.step2;
+            con->range = ROBUST_K;
+        }
+
+        // A positive constraint displaces every agent that now breaks it
+        unsigned int replanned = 1u << con->agent;
+        if (con->positive) {
+            for (int a = 0; a < num_agents; a++)
+                if (a != con->agent && (mask & (1u << a)) && violates_positive(child->cache->paths[a], con))
+                    replanned |= 1u << a;
+        }
+        int feasible = 1;
+        for (int a = 0; a < num_agents && feasible; a++)
+            if (replanned & (1u << a))
+                feasible = replan_agent(child, a);
+        if (!feasible) {
+            free_ct_node(child);
+            continue;
+        }
+        refresh_node(child, replanned, mask, heuristic);
+        children[count++] = child;
+        stats->generated++;
+    }
+    stats->expanded++;
+    return count;
+}
+
+// Depth-first search below a node that only follows children with f <= threshold and frees
+// each subtree once it is done, so only the current branch is held in memory. Lowers
+// *next_threshold to the smallest f it pruned.
+CTNode* ct_dfs(CTNode* node, CTNode* root, unsigned int mask, int heuristic, int threshold,
+               int* next_threshold, int node_limit, int keep_cache, CTStats* stats) {
+    if (node->conflict_pairs == 0) return node;
+    if (stats->generated > node_limit || ct_memory > CT_MEMORY_LIMIT) {
+        stats->aborted = 1;
+        return NULL;
+    }
+
+    CTNode* children[2];
+    int count = expand_ct_node(node, root, mask, heuristic, children, stats);
+    if (!keep_cache) drop_cache(node);
+    if (count == 2 && ct_node_before(children[1], children[0])) {
+        CTNode* tmp = children[0];
+        children[0] = children[1];
+        children[1] = tmp;
+    }
+
+    CTNode* goal = NULL;
+    for (int k = 0; k < count; k++) {
+        CTNode* child = children[k];
+        int f = child->cost + child->h;
+        if (!goal && !stats->aborted) {
+            if (f <= threshold)
+                goal = ct_dfs(child, root, mask, heuristic, threshold, next_threshold, node_limit, 0, stats);
+            else if (f < *next_threshold)
+                *next_threshold = f;
+            if (goal) continue; // The child is on the goal's branch
+        }
+        free_ct_node(child);
+    }
+    return goal;
+}
+
+// Near the memory cap the frontier stops growing. Each round searches depth-first below every
+// open node up to an f threshold, which then rises to the smallest f pruned in that round, so
+// the first goal found is still optimal.
+CTNode* ct_iterative_deepening(CTNode** open, int open_size, CTNode* root, unsigned int mask,
+                               int heuristic, int node_limit, CTStats* stats) {
+    stats->iterative_deepening = 1;
+    int threshold = open[0]->cost + open[0]->h;
+    while (threshold < INT_MAX) {
+        int next_threshold = INT_MAX;
+        for (int i = 0; i < open_size; i++) {
+            int f = open[i]->cost + open[i]->h;
+            if (f > threshold) {
+                if (f < next_threshold) next_threshold = f;
+                continue;
+            }
+            CTNode* goal = ct_dfs(open[i], root, mask, heuristic, threshold, &next_threshold, node_limit, 1, stats);
+            if (goal || stats->aborted) return goal;
+        }
+        threshold = next_threshold;
+    }
+    return NULL;
+}
+
+// Best-first search of the constraint tree below `root`, resolving conflicts among the agents
+// in `mask` only. Returns the first conflict-free node, or NULL when the tree is exhausted, more
+// than `node_limit` nodes were generated or the memory cap was hit. Nodes stay linked from
+// root->next_alloc; expanded nodes keep only their constraint and path deltas.
+CTNode* ct_search(CTNode* root, unsigned int mask, int heuristic, int node_limit, CTStats* stats) {
+    CTNode** open = NULL;
+    int open_size = 0, open_capacity = 0;
+    CTNode* result = NULL;
+    ct_heap_push(&open, &open_size, &open_capacity, root);
+
+    while (open_size > 0) {
+        if (ct_memory > CT_MEMORY_FALLBACK) {
+            result = ct_iterative_deepening(open, open_size, root, mask, heuristic, node_limit, stats);
+            break;
+        }
+        CTNode* node = ct_heap_pop(open, &open_size);
+        if (node->conflict_pairs == 0) {
+            result = node;
+            break;
+        }
+
+        CTNode* children[2];
+        int count = expand_ct_node(node, root, mask, heuristic, children, stats);
+        drop_cache(node);
+        for (int k = 0; k < count; k++)
+            ct_heap_push(&open, &open_size, &open_capacity, children[k]);
+        if (stats->generated > node_limit) {
+            stats->aborted = 1;
+            break;
+        }
+    }
+    free(open);
+    return result;
 }
 
 // Visualize grid at specific timestep with warnings
 void visualize_timestep(int step) {
-    static int goal_reported[MAX_AGENTS] = {0}; 
+    static int goal_reported[MAX_AGENTS] = {0};
     static int goal_time[MAX_AGENTS] = {0};
     printf("Timestep %d:\n", step);
     for (int r = 0; r < grid.rows; r++) {
@@ -212,12 +1068,9 @@ void visualize_timestep(int step) {
             }
         }
     }
-    // Report agents reaching goal
+    // Report agents reaching goal (for good: an agent may pass its goal earlier)
     for (int i = 0; i < num_agents; i++) {
-        if (!goal_reported[i] &&
-            step < agents[i].path_length &&
-            agents[i].path[step].row == agents[i].goal.row &&
-            agents[i].path[step].col == agents[i].goal.col) {
+        if (!goal_reported[i] && step == agents[i].cost) {
             printf("Agent %c reached its goal at timestep %d\n", 'A' + i, step);
             goal_reported[i] = 1;
             goal_time[i] = step;
@@ -242,144 +1095,56 @@ void visualize_timestep(int step) {
 int get_last_goal_timestep() {
     int last = 0;
     for (int i = 0; i < num_agents; i++) {
-        int t = 0;
-        for (; t < MAX_STEPS; t++) {
-            if (agents[i].path[t].row == agents[i].goal.row &&
-                agents[i].path[t].col == agents[i].goal.col) {
-                break;
-            }
-        }
-        if (t > last) last = t;
+        if (agents[i].cost > last) last = agents[i].cost;
     }
     return last;
 }
-// Prevent other agents from occupying an agent's goal after it reaches it
-void add_goal_occupation_constraints() {
-    int goal_time[MAX_AGENTS];
-    for (int i = 0; i < num_agents; i++) {
-        goal_time[i] = -1;
-        for (int t = 0; t < agents[i].path_length; t++) {
-            if (agents[i].path[t].row == agents[i].goal.row &&
-                agents[i].path[t].col == agents[i].goal.col) {
-                goal_time[i] = t;
-                break;
-            }
-        }
-    }
-    for (int i = 0; i < num_agents; i++) {
-        if (goal_time[i] == -1) continue;
-        for (int j = 0; j < num_agents; j++) {
-            if (i == j) continue;
-            for (int t = goal_time[i]; t < MAX_STEPS; t++) {
-                constraints[j][t][agents[i].goal.row][agents[i].goal.col] = 1;
-            }
-        }
-    }
-}
 
 // Conflict-Based Search (CBS) implementation
 void cbs() {
+    CTNode* root = new_ct_node(NULL, NULL);
+    memset(landmarks, -1, sizeof(landmarks));
+    unsigned int all = (num_agents >= 32) ? ~0u : (1u << num_agents) - 1;
+
     // Initial paths
     for (int i = 0; i < num_agents; i++) {
-        if (!a_star_search(i, constraints[i])) {
+        if (!replan_agent(root, i)) {
             printf("Agent %c cannot find initial path\n", 'A' + i);
             exit(1);
         }
         printf("Agent %c path found\n", 'A' + i);
-        for (int j = 0; j < agents[i].path_length; j++)
+        for (int j = 0; j <= agents[i].cost; j++)
             printf("(%d, %d) -> ", agents[i].path[j].row, agents[i].path[j].col);
         printf("\n");
     }
+    refresh_node(root, all, all, CBS_HEURISTIC);
 
-    add_goal_occupation_constraints();
-    // Replan with constraints applied
-    for (int i = 0; i < num_agents; i++) {
-        if (!a_star_search(i, constraints[i])) {
-            printf("Agent %c cannot find path after adding goal occupation constraints\n", 'A' + i);
-            exit(1);
-        }
+    // Best-first search over the constraint tree
+    CTStats stats = {0};
+    stats.generated = 1;
+    CTNode* goal = ct_search(root, all, CBS_HEURISTIC, MAX_CT_NODES, &stats);
+    if (!goal) {
+        printf("CBS found no conflict-free solution (%d CT nodes generated, %lu KB of CT memory).\n",
+            stats.generated, (unsigned long)(ct_peak_memory / 1024));
+        exit(1);
     }
+    printf("CBS expanded %d and generated %d CT nodes; sum of costs %d (root %d, root h %d)\n",
+        stats.expanded, stats.generated, goal->cost, root->cost, root->h);
+    if (ROBUST_K > 0)
+        printf("Plan is %d-robust: it stays conflict-free if agents fall up to %d steps behind\n", ROBUST_K, ROBUST_K);
+    printf("CBS peak CT memory %lu KB%s\n", (unsigned long)(ct_peak_memory / 1024),
+        stats.iterative_deepening ? " (iterative deepening near the memory cap)" : "");
 
-    int replan_limit = 10000;
-    int replan_count = 0;
-    // Conflict detection and resolution loop
-    int step = 1;
-    while (step < MAX_STEPS) {
-        int conflict_found = 0;
-        for (int i = 0; i < num_agents && !conflict_found; i++) {
-            for (int j = i + 1; j < num_agents && !conflict_found; j++) {
-                if (step >= agents[i].path_length || step >= agents[j].path_length)
-                    continue;
-
-                Position a_prev = agents[i].path[step - 1];
-                Position b_prev = agents[j].path[step - 1];
-                Position a_curr = agents[i].path[step];
-                Position b_curr = agents[j].path[step];
-
-                if (has_conflict(a_curr, step, b_curr, step, a_prev, b_prev)) {
-                    printf("Conflict detected between agent %c and agent %c at step %d\n", 'A' + i, 'A' + j, step);
-
-                    int first = (agents[i].path_length <= agents[j].path_length) ? i : j;
-                    int second = (first == i) ? j : i;
-
-                    // Add vertex constraint for the replanned agent at the conflicting cell
-                    int row = (first == i ? a_curr.row : b_curr.row);
-                    int col = (first == i ? a_curr.col : b_curr.col);
-                    constraints[first][step][row][col] = 1;
-
-                    // Add swap (edge) constraint for the replanned agent if it's a swap conflict
-                    int swap = 0;
-                    int swap_row = 0, swap_col = 0;
-                    if (a_prev.row == b_curr.row && a_prev.col == b_curr.col &&
-                        b_prev.row == a_curr.row && b_prev.col == a_curr.col) {
-                        swap = 1;
-                        swap_row = (first == i ? b_curr.row : a_curr.row);
-                        swap_col = (first == i ? b_curr.col : a_curr.col);
-                        constraints[first][step - 1][swap_row][swap_col] = 1;
-                    }
-
-                    if (!a_star_search(first, constraints[first])) {
-                        // Remove the constraints for the first agent before trying the second
-                        constraints[first][step][row][col] = 0;
-                        if (swap) constraints[first][step - 1][swap_row][swap_col] = 0;
-
-                        // Now try the second agent
-                        row = (second == i ? a_curr.row : b_curr.row);
-                        col = (second == i ? a_curr.col : b_curr.col);
-                        constraints[second][step][row][col] = 1;
-                        if (swap) constraints[second][step - 1][(second == i ? b_curr.row : a_curr.row)][(second == i ? b_curr.col : a_curr.col)] = 1;
-
-                        if (!a_star_search(second, constraints[second])) {
-                            printf("Both agent %c and agent %c failed to replan at step %d.\n", 'A' + i, 'A' + j, step);
-                            exit(1);
-                        }
-                    }
-
-                    // After any replan, re-apply goal occupation constraints and replan all agents
-                    add_goal_occupation_constraints();
-                    for (int k = 0; k < num_agents; k++) {
-                        if (!a_star_search(k, constraints[k])) {
-                            printf("Agent %c cannot find path after adding goal occupation constraints\n", 'A' + k);
-                            exit(1);
-                        }
-                    }
-
-                    if (++replan_count > replan_limit) {
-                        printf("Too many replans, problem may be unsolvable with current constraints.\n");
-                        exit(1);
-                    }
-
-                    conflict_found = 1;
-                    break;
-                }
-            }
-        }
-        if (conflict_found) {
-            step = 1; // Restart checking from the beginning
-        } else {
-            step++;
-        }
+    // Rebuild the full solution from the goal's branch
+    const PathDelta* paths[MAX_AGENTS];
+    collect_paths(goal, paths);
+    for (int i = 0; i < num_agents; i++) {
+        agents[i].cost = paths[i]->cost;
+        agents[i].path_length = MAX_STEPS;
+        for (int t = 0; t < MAX_STEPS; t++)
+            agents[i].path[t] = path_at(paths[i], t);
     }
+    free_ct_nodes(root);
 
     int last_goal_step = get_last_goal_timestep();
 
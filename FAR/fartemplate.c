@@ -2,20 +2,84 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
 #include <limits.h>
 #include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/resource.h>
 // Maximum number of agents and map size
 #define MAX_AGENTS 26
+#ifndef MAX_MAP
 #define MAX_MAP 32
+#endif
+#define MAX_ROUTE (MAX_MAP * MAX_MAP * 2) // Longest route an agent keeps, detours included
+#define REPAIR_HORIZON 4 // Route cells past a blocked one that a local repair tries to rejoin
+#define FLOW_PENALTY 2   // Extra cost of a move against the flow
+#define RESERVE_AHEAD 2  // Cells of its route an agent reserves before moving
+#define PARK_RADIUS 8    // How far an agent breaking a deadlock looks for a cell to step aside into
+#define PARK_HOLD 2      // Timesteps it stays there to let the others pass
+#define STALL_STEPS 12   // Timesteps without getting closer to its goal before an agent escalates
+#define LIVELOCK_WINDOW 16 // Recent states checked for a repeat that means agents go round in circles
+#ifndef PARALLEL_STEP
+#define PARALLEL_STEP 0  // 1: agents propose moves in parallel and conflicts are arbitrated by priority
+#endif
+#define STEP_THREADS 4   // Threads proposing moves when PARALLEL_STEP (build with -pthread)
+#ifndef USE_CONGESTION
+#define USE_CONGESTION 0   // 1: A* charges for cells that were crowded recently
+#endif
+#ifndef CONGESTION_WEIGHT
+#define CONGESTION_WEIGHT 2.0 // Extra cost of a cell per agent recently on it
+#endif
+#ifndef CONGESTION_DECAY
+#define CONGESTION_DECAY 0.8  // Share of a cell's congestion left after each timestep
+#endif
+#define CONGESTION_MEMORY 32  // Timesteps after which congestion is treated as gone
+#ifndef USE_FLOW_FIELDS
+#define USE_FLOW_FIELDS 0 // 1: agents descend shared per-goal distance fields instead of following A* routes
+#endif
+#define MAX_FIELDS MAX_AGENTS
+// Bits of a cell in the flow graph
+#define MOVE_OPEN(d) (1 << (d))          // Move d leads to a traversable cell
+#define MOVE_AGAINST(d) (1 << ((d) + 4)) // Move d goes against the flow
+
+// Escalation of a stalled agent
+#define ESCALATE_NONE 0
+#define ESCALATE_REPLAN 1 // Dropped its reservations and planned afresh
+#define ESCALATE_BOOST 2  // Moves first and never gives way in a deadlock
+#define ESCALATE_GIVE_UP 3
+
+// Which agents a search treats as walls
+#define AVOID_NONE 0
+#define AVOID_FINISHED 1
+#define AVOID_ALL 2
 // Struct to represent coordinates
 typedef struct {
     int x, y;
 } Point;
+// Cost of reaching one goal from every cell along the flow graph, shared by agents with that goal
+typedef struct {
+    Point goal;
+    int epoch; // flow_epoch the field was computed under
+    int dist[MAX_MAP][MAX_MAP];
+} FlowField;
 // Struct to represent an agent with ID, start/goal/position, and statu
 typedef struct {
     char id;
     Point start, goal, pos;
     bool done;
+    Point route[MAX_ROUTE]; // Planned cells, route[route_pos] is the current position
+    int route_len, route_pos;
+    int route_epoch;        // flow_epoch the route was planned under
+    int hold;               // Timesteps left to stay parked at the end of the route
+    int best_dist;          // Closest the agent has been to its goal
+    int last_progress;      // Timestep it last got closer
+    int escalated_at;       // Timestep of its last escalation
+    int escalation;         // ESCALATE_* step reached while stalled
+    FlowField *field;       // Field of the agent's goal when USE_FLOW_FIELDS
+    Point held[RESERVE_AHEAD]; // Cells reserved ahead of the agent
+    int held_count;
 } Agent;
 // Node for A* search tree
 typedef struct Node {
@@ -23,6 +87,13 @@ typedef struct Node {
     int cost, priority;
     struct Node *parent;
 } Node;
+// Per-cell A* state, valid only where stamp matches the current search
+typedef struct {
+    int cost, priority;
+    int parent;     // Cell index, -1 at the start
+    int heap_index; // Position in the open heap, -1 once closed
+    int stamp;
+} SearchCell;
 
 // Global variables
 char map[MAX_MAP][MAX_MAP];      // Static map layout
@@ -31,6 +102,43 @@ int width = 10, height = 10;
 Agent agents[MAX_AGENTS];        // Agent list
 int agent_count = 0;
 int density[MAX_MAP][MAX_MAP] = {0}; // Tracks congestion for deadlock resolution
+// Exponentially decayed occupancy. Cells are decayed lazily from the timestep they were last
+// touched, so a timestep only updates the cells agents stand on.
+bool use_congestion = USE_CONGESTION;
+float heat[MAX_MAP][MAX_MAP];
+unsigned heat_stamp[MAX_MAP][MAX_MAP], heat_now = 0; // Unsigned: ages stay right when the clock wraps
+float decay_pow[CONGESTION_MEMORY]; // CONGESTION_DECAY^t
+bool verbose = true; // Draw each timestep and report arrivals
+long long deadlocks_broken = 0;
+int makespan = 0; // Timestep the last agent finished
+int timesteps_run = 0; // Timesteps the last simulate() ran for
+int occupant[MAX_MAP][MAX_MAP];      // Index of the agent on each cell, -1 if none
+int reserved[MAX_MAP][MAX_MAP];      // Index of the agent holding each cell ahead of it, -1 if none
+// Wait-for graph of the current timestep: each waiting agent points at the agent in its way.
+// Union-find over it detects a cycle in near O(1) as the edge closing it is added.
+int waits_for[MAX_AGENTS], wait_root[MAX_AGENTS];
+int cycles[MAX_AGENTS][MAX_AGENTS], cycle_len[MAX_AGENTS], cycle_count = 0;
+int order[MAX_AGENTS]; // Order agents move in each timestep, boosted agents first
+// Recent state hashes with the progress count each was seen at, for livelock detection
+uint64_t state_history[LIVELOCK_WINDOW];
+unsigned state_progress[LIVELOCK_WINDOW];
+int state_count = 0; // States recorded, folded back into [LIVELOCK_WINDOW, 2 * LIVELOCK_WINDOW)
+unsigned progress_count = 0; // Bumped whenever an agent gets closer to its goal than ever before
+int last_any_progress = 0; // Timestep of the last such progress
+// Diagnostic record of an agent still stuck when the simulation gives up
+typedef struct {
+    int agent;
+    Point pos;
+    int dist, best_dist, last_progress;
+    int waiting_on; // Agent it waited on in the last timestep, -1 if none
+} StallRecord;
+StallRecord stalls[MAX_AGENTS];
+int stall_count = 0;
+unsigned char flow[MAX_MAP][MAX_MAP]; // Flow-annotated directed graph, one byte of MOVE_* bits per cell
+int row_lane[MAX_MAP], col_lane[MAX_MAP]; // Index of each row and column among those agents can travel along
+int flow_epoch = 0; // Bumped whenever the map or its flow changes, invalidating every route
+FlowField fields[MAX_FIELDS];
+int field_count = 0;
 // Directions (up, down, left, right)
 int dx[4] = {0, 0, -1, 1};
 int dy[4] = {-1, 1, 0, 0};
@@ -38,80 +146,464 @@ int dy[4] = {-1, 1, 0, 0};
 bool is_valid(int x, int y) {
     return x >= 0 && y >= 0 && x < width && y < height && map[y][x] != '#';
 }
+// Index of the agent on (x, y) other than `exclude`, or -1
+int agent_at(int x, int y, int exclude) {
+    int i = occupant[y][x];
+    return (i == exclude) ? -1 : i;
+}
 // Check if (x, y) is occupied by any agent except the one at `exclude` index
 bool is_occupied(int x, int y, int exclude) {
+    return agent_at(x, y, exclude) != -1;
+}
+// Build the occupancy index from the agents' positions
+void index_agents() {
+    memset(occupant, -1, sizeof(occupant));
+    memset(reserved, -1, sizeof(reserved));
     for (int i = 0; i < agent_count; ++i)
-        if (i != exclude && agents[i].pos.x == x && agents[i].pos.y == y)
-            return true;
-    return false;
+        occupant[agents[i].pos.y][agents[i].pos.x] = i;
+}
+// Move an agent, keeping the occupancy index and density map up to date
+void move_agent(int idx, Point to) {
+    Agent *a = &agents[idx];
+    occupant[a->pos.y][a->pos.x] = -1;
+    density[a->pos.y][a->pos.x]--;
+    a->pos = to;
+    occupant[to.y][to.x] = idx;
+    density[to.y][to.x]++;
 }
-// Add penalty if movement contradicts flow direction
-int flow_penalty(Point from, Point to) {
-    int penalty = 0;
-    if (from.y % 2 == 0 && to.x < from.x) penalty += 2;
-    if (from.y % 2 == 1 && to.x > from.x) penalty += 2;
-    if (from.x % 2 == 0 && to.y < from.y) penalty += 2;
-    if (from.x % 2 == 1 && to.y > from.y) penalty += 2;
-    return penalty;
+// Decayed congestion of a cell at the current timestep
+float congestion(int x, int y) {
+    unsigned age = heat_now - heat_stamp[y][x];
+    return age < CONGESTION_MEMORY ? heat[y][x] * decay_pow[age] : 0.0f;
+}
+// Advance the congestion map by one timestep with every agent's current cell
+void update_congestion() {
+    if (decay_pow[0] == 0.0f) {
+        decay_pow[0] = 1.0f;
+        for (int t = 1; t < CONGESTION_MEMORY; ++t)
+            decay_pow[t] = decay_pow[t - 1] * CONGESTION_DECAY;
+    }
+    heat_now++;
+    for (int i = 0; i < agent_count; ++i) {
+        Point p = agents[i].pos;
+        heat[p.y][p.x] = congestion(p.x, p.y) + 1.0f;
+        heat_stamp[p.y][p.x] = heat_now;
+    }
+}
+// Whether move d out of (x, y) goes against the default flow. Travelable rows and columns
+// alternate direction; a cell marked '<', '>', '^' or 'v' on the map fixes its axis instead.
+bool against_flow(int x, int y, int d) {
+    char c = map[y][x];
+    if (d == 2 || d == 3) {
+        bool east = (c == '>') || (c != '<' && row_lane[y] % 2 == 0);
+        return east ? d == 2 : d == 3;
+    }
+    bool down = (c == 'v') || (c != '^' && col_lane[x] % 2 == 0);
+    return down ? d == 0 : d == 1;
+}
+// Makes the move d out of (x, y) and the move back free of penalty
+void open_both_ways(int x, int y, int d) {
+    flow[y][x] &= ~MOVE_AGAINST(d);
+    flow[y + dy[d]][x + dx[d]] &= ~MOVE_AGAINST(d ^ 1);
+}
+// Marks the cells reachable from (x, y) along with-flow moves, or that reach it when `backward`
+void flow_reach(int x, int y, bool backward, bool reached[MAX_MAP][MAX_MAP]) {
+    static Point queue[MAX_MAP * MAX_MAP];
+    int head = 0, tail = 0;
+    memset(reached, 0, sizeof(bool) * MAX_MAP * MAX_MAP);
+    reached[y][x] = true;
+    queue[tail++] = (Point){x, y};
+    while (head < tail) {
+        Point p = queue[head++];
+        for (int d = 0; d < 4; ++d) {
+            if (!(flow[p.y][p.x] & MOVE_OPEN(d))) continue;
+            int nx = p.x + dx[d], ny = p.y + dy[d];
+            // Backward, the move that matters is the one from the neighbour into p
+            unsigned char bits = backward ? flow[ny][nx] : flow[p.y][p.x];
+            int move = backward ? d ^ 1 : d;
+            if (reached[ny][nx] || (bits & MOVE_AGAINST(move))) continue;
+            reached[ny][nx] = true;
+            queue[tail++] = (Point){nx, ny};
+        }
+    }
+}
+// Builds the flow graph once per map: alternating row and column directions, two-way dead
+// ends and the corridors leading into them, then connectivity repair so that every cell can
+// reach every other cell of its region without moving against the flow
+void build_flow_graph() {
+    static bool two_way[MAX_MAP][MAX_MAP], forward[MAX_MAP][MAX_MAP], backward[MAX_MAP][MAX_MAP];
+    static bool connected[MAX_MAP][MAX_MAP];
+    memset(flow, 0, sizeof(flow));
+    memset(two_way, 0, sizeof(two_way));
+    memset(connected, 0, sizeof(connected));
+    // Lanes are the rows and columns with at least one move along them
+    int lanes = 0;
+    for (int y = 0; y < height; ++y) {
+        row_lane[y] = lanes;
+        for (int x = 0; x + 1 < width; ++x)
+            if (is_valid(x, y) && is_valid(x + 1, y)) {
+                lanes++;
+                break;
+            }
+    }
+    lanes = 0;
+    for (int x = 0; x < width; ++x) {
+        col_lane[x] = lanes;
+        for (int y = 0; y + 1 < height; ++y)
+            if (is_valid(x, y) && is_valid(x, y + 1)) {
+                lanes++;
+                break;
+            }
+    }
+    // Walls get their outgoing moves too, since agents may start parked on them
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x) {
+            for (int d = 0; d < 4; ++d) {
+                if (!is_valid(x + dx[d], y + dy[d])) continue;
+                flow[y][x] |= MOVE_OPEN(d);
+                if (against_flow(x, y, d)) flow[y][x] |= MOVE_AGAINST(d);
+            }
+        }
+
+    // An agent has to come back out of a dead end the way it went in
+    for (bool grew = true; grew;) {
+        grew = false;
+        for (int y = 0; y < height; ++y)
+            for (int x = 0; x < width; ++x) {
+                if (!is_valid(x, y) || two_way[y][x]) continue;
+                int degree = 0, toward_dead_end = 0;
+                for (int d = 0; d < 4; ++d) {
+                    if (!(flow[y][x] & MOVE_OPEN(d))) continue;
+                    degree++;
+                    if (two_way[y + dy[d]][x + dx[d]]) toward_dead_end++;
+                }
+                if (degree == 1 || (degree == 2 && toward_dead_end > 0)) {
+                    two_way[y][x] = grew = true;
+                    for (int d = 0; d < 4; ++d)
+                        if (flow[y][x] & MOVE_OPEN(d)) open_both_ways(x, y, d);
+                }
+            }
+    }
+
+    // Grow a strongly connected set from each unvisited cell until it covers the cell's whole
+    // region, lifting the penalty of each move that leaves it or leads back into it when needed
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x) {
+            if (!is_valid(x, y) || connected[y][x]) continue;
+            for (bool grew = true; grew;) {
+                grew = false;
+                flow_reach(x, y, false, forward);
+                flow_reach(x, y, true, backward);
+                for (int cy = 0; cy < height; ++cy)
+                    for (int cx = 0; cx < width; ++cx) {
+                        if (!forward[cy][cx] || !backward[cy][cx]) continue;
+                        for (int d = 0; d < 4; ++d) {
+                            if (!(flow[cy][cx] & MOVE_OPEN(d))) continue;
+                            int nx = cx + dx[d], ny = cy + dy[d];
+                            if (!forward[ny][nx]) {
+                                flow[cy][cx] &= ~MOVE_AGAINST(d);
+                                grew = true;
+                            }
+                            if (!backward[ny][nx]) {
+                                flow[ny][nx] &= ~MOVE_AGAINST(d ^ 1);
+                                grew = true;
+                            }
+                        }
+                    }
+            }
+            for (int cy = 0; cy < height; ++cy)
+                for (int cx = 0; cx < width; ++cx)
+                    if (forward[cy][cx] && backward[cy][cx]) connected[cy][cx] = true;
+        }
+    flow_epoch++;
 }
 // Manhattan distance heuristic for A*
 int heuristic(Point a, Point b) {
     return abs(a.x - b.x) + abs(a.y - b.y);
 }
-// Create a new node for A* search
+// A* scratch space, grown with the map and reused by every search. It is per thread so that
+// agents can plan in parallel.
+_Thread_local SearchCell *search_cells = NULL;
+_Thread_local int *open_heap = NULL; // Min-heap of cell indices ordered by priority
+_Thread_local Node *path_arena = NULL; // Nodes of the last path found, reset by each search
+_Thread_local int search_capacity = 0, open_len = 0, search_id = 0, arena_len = 0;
+_Thread_local int arena_peak = 0;   // Most path nodes one search has needed
+_Thread_local int search_wraps = 0; // Times search_id ran out and the stamps were cleared
+_Thread_local long long expansions = 0; // Nodes expanded by this thread's searches so far
+
+// Create a new node for A* search in the path arena
 Node *new_node(int x, int y, int cost, int priority, Node *parent) {
-    Node *n = malloc(sizeof(Node));
+    Node *n = &path_arena[arena_len++];
     n->pt = (Point){x, y};
     n->cost = cost;
     n->priority = priority;
     n->parent = parent;
     return n;
 }
-// A* search algorithm for an agent
-Node *a_star(Agent *a) {
-    Node *open[1024];
-    bool closed[MAX_MAP][MAX_MAP] = { false };
-    int open_len = 0;
 
-    Node *start = new_node(a->pos.x, a->pos.y, 0, heuristic(a->pos, a->goal), NULL);
-    open[open_len++] = start;
+void heap_place(int i, int cell) {
+    open_heap[i] = cell;
+    search_cells[cell].heap_index = i;
+}
+void heap_sift_up(int i) {
+    int cell = open_heap[i];
+    while (i > 0 && search_cells[open_heap[(i - 1) / 2]].priority > search_cells[cell].priority) {
+        heap_place(i, open_heap[(i - 1) / 2]);
+        i = (i - 1) / 2;
+    }
+    heap_place(i, cell);
+}
+int heap_pop() {
+    int top = open_heap[0];
+    int cell = open_heap[--open_len];
+    int i = 0;
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= open_len) break;
+        if (child + 1 < open_len && search_cells[open_heap[child + 1]].priority < search_cells[open_heap[child]].priority)
+            child++;
+        if (search_cells[open_heap[child]].priority >= search_cells[cell].priority) break;
+        heap_place(i, open_heap[child]);
+        i = child;
+    }
+    if (open_len > 0) heap_place(i, cell);
+    search_cells[top].heap_index = -1;
+    return top;
+}
+// Opens a cell, or lowers its priority if this path to it is better; a cell is in the heap at
+// most once, so the heap never holds more than width * height entries
+void heap_offer(int cell, int cost, int priority, int parent) {
+    SearchCell *c = &search_cells[cell];
+    if (c->stamp == search_id) {
+        if (c->heap_index < 0 || priority >= c->priority) return;
+    } else {
+        c->stamp = search_id;
+        heap_place(open_len++, cell);
+    }
+    c->cost = cost;
+    c->priority = priority;
+    c->parent = parent;
+    heap_sift_up(c->heap_index);
+}
+// A* search algorithm from an agent's position to `target`, treating the cells of the other
+// agents selected by `avoid` as walls. The path lives in this thread's arena and is only valid
+// until its next search, so callers copy it out straight away.
+Node *a_star(Agent *a, Point target, int avoid) {
+    if (search_capacity < width * height) {
+        search_capacity = width * height;
+        search_cells = realloc(search_cells, sizeof(SearchCell) * search_capacity);
+        open_heap = realloc(open_heap, sizeof(int) * search_capacity);
+        path_arena = realloc(path_arena, sizeof(Node) * search_capacity);
+        memset(search_cells, 0, sizeof(SearchCell) * search_capacity);
+        search_id = 0;
+    }
+    if (search_id == INT_MAX) {
+        memset(search_cells, 0, sizeof(SearchCell) * search_capacity);
+        search_id = 0;
+        search_wraps++;
+    }
+    search_id++;
+    open_len = 0;
+    arena_len = 0;
+    heap_offer(a->pos.y * width + a->pos.x, 0, heuristic(a->pos, target), -1);
 
     while (open_len) {
         // Get node with lowest priority (best path estimate)
-        int min_i = 0;
-        for (int i = 1; i < open_len; i++)
-            if (open[i]->priority < open[min_i]->priority)
-                min_i = i;
-
-        Node *curr = open[min_i];
-        open[min_i] = open[--open_len];
-        // Reached goal
-        if (curr->pt.x == a->goal.x && curr->pt.y == a->goal.y)
-            return curr;
-
-        if (closed[curr->pt.y][curr->pt.x]) {
-            free(curr);
-            continue;
+        int cell = heap_pop();
+        Point curr = {cell % width, cell / width};
+        // Reached target: hand back the path as a chain of nodes ending at the target
+        if (curr.x == target.x && curr.y == target.y) {
+            Node *path = NULL, *last = NULL;
+            for (int c = cell; c >= 0; c = search_cells[c].parent) {
+                Node *n = new_node(c % width, c / width, search_cells[c].cost, search_cells[c].priority, NULL);
+                if (last) last->parent = n;
+                else path = n;
+                last = n;
+            }
+            if (arena_len > arena_peak) arena_peak = arena_len;
+            return path;
         }
-        closed[curr->pt.y][curr->pt.x] = true;
+        expansions++;
         // Explore neighbors
+        unsigned char moves = flow[curr.y][curr.x];
         for (int d = 0; d < 4; ++d) {
-            int nx = curr->pt.x + dx[d], ny = curr->pt.y + dy[d];
-            if (!is_valid(nx, ny)) continue;
-            if (is_occupied(nx, ny, a - agents) && !(nx == a->goal.x && ny == a->goal.y)) continue;
+            if (!(moves & MOVE_OPEN(d))) continue;
+            int nx = curr.x + dx[d], ny = curr.y + dy[d];
+            int other = avoid == AVOID_NONE ? -1 : agent_at(nx, ny, a - agents);
+            if (other != -1 && (avoid == AVOID_ALL || agents[other].done) && !(nx == target.x && ny == target.y)) continue;
 
             Point next = {nx, ny};
-            int cost = curr->cost + 1;
-            int priority = cost + heuristic(next, a->goal) + flow_penalty(curr->pt, next);
-            Node *child = new_node(nx, ny, cost, priority, curr);
-            open[open_len++] = child;
+            // Every move costs at least 1, so Manhattan distance stays admissible and consistent
+            int cost = search_cells[cell].cost + 1 + ((moves & MOVE_AGAINST(d)) ? FLOW_PENALTY : 0);
+            if (use_congestion) cost += (int)(CONGESTION_WEIGHT * congestion(nx, ny) + 0.5f);
+            int priority = cost + heuristic(next, target);
+            heap_offer(ny * width + nx, cost, priority, cell);
         }
     }
 
     return NULL;// No path found
 }
+// Store a search result as the agent's route, followed by its old route after index `rejoin`
+// (-1 keeps none of it). Fails if the result does not fit.
+bool store_route(Agent *a, Node *path, int rejoin) {
+    int len = 0;
+    for (Node *n = path; n; n = n->parent) len++;
+    int tail = (rejoin >= 0) ? a->route_len - rejoin - 1 : 0;
+    bool fits = len + tail <= MAX_ROUTE;
+    if (fits) {
+        memmove(&a->route[len], &a->route[rejoin + 1], sizeof(Point) * tail);
+        int i = len;
+        for (Node *n = path; n; n = n->parent)
+            a->route[--i] = n->pt;
+        a->route_len = len + tail;
+        a->route_pos = 0;
+        a->route_epoch = flow_epoch;
+    }
+    return fits;
+}
+// Plan a full route to the goal around the agents standing in the way, or through the ones
+// still moving when they wall the agent in
+bool plan_route(int idx) {
+    Agent *a = &agents[idx];
+    Node *path = a_star(a, a->goal, AVOID_ALL);
+    if (!path) path = a_star(a, a->goal, AVOID_FINISHED);
+    if (!path) path = a_star(a, a->goal, AVOID_NONE);
+    return path && store_route(a, path, -1);
+}
+// Local repair when the next route cell is blocked: detour to one of the next few free route
+// cells and keep the rest of the route, or replan from scratch if none can be reached
+bool repair_route(int idx) {
+    Agent *a = &agents[idx];
+    int blocked = a->route_pos + 1;
+    for (int k = blocked + 1; k < a->route_len && k <= blocked + REPAIR_HORIZON; k++) {
+        Point p = a->route[k];
+        if (is_occupied(p.x, p.y, idx)) continue;
+        Node *detour = a_star(a, p, AVOID_ALL);
+        if (detour && store_route(a, detour, k)) return true;
+        break;
+    }
+    return plan_route(idx);
+}
+// Backward Dijkstra from the goal over the flow graph. Moves cost 1, plus FLOW_PENALTY against
+// the flow, so a circular array of FLOW_PENALTY + 2 buckets serves as the priority queue.
+void compute_field(FlowField *f) {
+    static Point bucket[FLOW_PENALTY + 2][MAX_MAP * MAX_MAP * 4];
+    int len[FLOW_PENALTY + 2] = {0};
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+            f->dist[y][x] = INT_MAX;
+    f->dist[f->goal.y][f->goal.x] = 0;
+    bucket[0][len[0]++] = f->goal;
+    for (int level = 0, pending = 1; pending > 0; ++level) {
+        int b = level % (FLOW_PENALTY + 2);
+        for (int k = 0; k < len[b]; ++k) {
+            Point w = bucket[b][k];
+            pending--;
+            if (f->dist[w.y][w.x] != level) continue;
+            // Cells whose move d leads into w
+            for (int d = 0; d < 4; ++d) {
+                int vx = w.x - dx[d], vy = w.y - dy[d];
+                if (vx < 0 || vy < 0 || vx >= width || vy >= height) continue;
+                if (!(flow[vy][vx] & MOVE_OPEN(d))) continue;
+                int dist = level + 1 + ((flow[vy][vx] & MOVE_AGAINST(d)) ? FLOW_PENALTY : 0);
+                if (dist >= f->dist[vy][vx]) continue;
+                f->dist[vy][vx] = dist;
+                int nb = dist % (FLOW_PENALTY + 2);
+                bucket[nb][len[nb]++] = (Point){vx, vy};
+                pending++;
+            }
+        }
+        len[b] = 0;
+    }
+    f->epoch = flow_epoch;
+}
+// Whether some agent is heading for the goal of a field
+bool field_in_use(const FlowField *f) {
+    for (int i = 0; i < agent_count; ++i)
+        if (agents[i].goal.x == f->goal.x && agents[i].goal.y == f->goal.y) return true;
+    return false;
+}
+// Field of a goal, computed on first use and again only after the flow graph changed. Once the
+// table is full, a field whose goal no agent is heading for any more is reused.
+FlowField *field_for(Point goal) {
+    FlowField *f = NULL;
+    for (int i = 0; i < field_count && !f; ++i)
+        if (fields[i].goal.x == goal.x && fields[i].goal.y == goal.y)
+            f = &fields[i];
+    if (!f) {
+        for (int i = 0; i < field_count && !f && field_count == MAX_FIELDS; ++i)
+            if (!field_in_use(&fields[i])) f = &fields[i];
+        if (!f) {
+            if (field_count == MAX_FIELDS) return NULL;
+            f = &fields[field_count++];
+        }
+        f->goal = goal;
+        f->epoch = flow_epoch - 1;
+    }
+    if (f->epoch != flow_epoch) compute_field(f);
+    return f;
+}
+// Next cell down the goal's field: the best free neighbour that gets closer, otherwise the best
+// neighbour even if occupied, so that the agent waits on it
+bool field_step(int idx, Point *next) {
+    Agent *a = &agents[idx];
+    if (!a->field || a->field->epoch != flow_epoch) a->field = field_for(a->goal);
+    if (!a->field || a->field->dist[a->pos.y][a->pos.x] == INT_MAX) return false;
+    int here = a->field->dist[a->pos.y][a->pos.x];
+    unsigned char moves = flow[a->pos.y][a->pos.x];
+    int best = INT_MAX, best_free = INT_MAX;
+    *next = a->pos;
+    Point free_next = a->pos;
+    for (int d = 0; d < 4; ++d) {
+        if (!(moves & MOVE_OPEN(d))) continue;
+        int nx = a->pos.x + dx[d], ny = a->pos.y + dy[d];
+        int dist = a->field->dist[ny][nx];
+        if (dist >= here) continue;
+        int value = dist + ((moves & MOVE_AGAINST(d)) ? FLOW_PENALTY : 0);
+        if (value < best) {
+            best = value;
+            *next = (Point){nx, ny};
+        }
+        if (value < best_free && !is_occupied(nx, ny, idx)) {
+            best_free = value;
+            free_next = (Point){nx, ny};
+        }
+    }
+    if (best_free != INT_MAX) *next = free_next;
+    return true;
+}
+// Change a static cell. Lane directions follow each lane's index among all lanes, so one wall
+// can turn the flow anywhere on the map: the graph is rebuilt, and every route and field is
+// recomputed in full, lazily, the next time an agent needs it.
+void set_wall(int x, int y, bool wall) {
+    map[y][x] = wall ? '#' : '.';
+    build_flow_graph();
+}
+// Whether a cell holds an agent that has finished and will not make way
+bool held_by_finished(Point p, int exclude) {
+    int j = agent_at(p.x, p.y, exclude);
+    return j != -1 && agents[j].done;
+}
+// Next cell on the agent's route, replanning first if it has none or was pushed off it.
+// With flow fields the agent only keeps a route while detouring around finished agents.
+bool next_step(int idx, Point *next) {
+    Agent *a = &agents[idx];
+    bool on_route = a->route_len > 0 && a->route_epoch == flow_epoch &&
+        a->route[a->route_pos].x == a->pos.x && a->route[a->route_pos].y == a->pos.y &&
+        (a->route_pos + 1 < a->route_len || (a->pos.x == a->goal.x && a->pos.y == a->goal.y));
+    if (USE_FLOW_FIELDS && !on_route) {
+        a->route_len = 0;
+        if (!field_step(idx, next)) return false;
+        if (!held_by_finished(*next, idx) || !plan_route(idx)) return true;
+    } else if (!on_route && !plan_route(idx)) {
+        return false;
+    }
+    *next = (a->route_pos + 1 < a->route_len) ? a->route[a->route_pos + 1] : a->pos;
+    return true;
+}
 // Display map and agents at current timestep
 void visualize_with_timestep(int timestep) {
+    if (!verbose) return;
     memcpy(display, map, sizeof(map));
     for (int i = 0; i < agent_count; ++i)
         display[agents[i].goal.y][agents[i].goal.x] = '+';
@@ -126,27 +618,70 @@ void visualize_with_timestep(int timestep) {
     usleep(300000); // Delay for animation
 }
 
-// Recursively detect cycles in blocking chain
-int find_blocking_chain(int idx, bool visited[]) {
-    if (visited[idx]) return idx;
-    visited[idx] = true;
-
+// Drop every reservation an agent holds
+void release_reservations(int idx) {
     Agent *a = &agents[idx];
-    Node *path = a_star(a);
-    if (!path) return -1;
-
-    Node *step = path;
-    while (step->parent && step->parent->parent) step = step->parent;
-    int tx = step->pt.x, ty = step->pt.y;
-
-    for (int i = 0; i < agent_count; i++) {
-        if (i != idx && agents[i].pos.x == tx && agents[i].pos.y == ty && !agents[i].done)
-            return find_blocking_chain(i, visited);
+    for (int k = 0; k < a->held_count; ++k)
+        if (reserved[a->held[k].y][a->held[k].x] == idx)
+            reserved[a->held[k].y][a->held[k].x] = -1;
+    a->held_count = 0;
+}
+// Reserve `next` and the route cells after it, up to RESERVE_AHEAD, stopping at the first cell
+// another agent stands on or holds. Returns whether the agent may move to `next`.
+bool reserve_ahead(int idx, Point next) {
+    Agent *a = &agents[idx];
+    release_reservations(idx);
+    bool on_route = a->route_len > 0 && a->route_pos + 1 < a->route_len &&
+        a->route[a->route_pos + 1].x == next.x && a->route[a->route_pos + 1].y == next.y;
+    for (int k = 0; k < RESERVE_AHEAD; ++k) {
+        Point p = next;
+        if (k > 0) {
+            if (!on_route || a->route_pos + 1 + k >= a->route_len) break;
+            p = a->route[a->route_pos + 1 + k];
+        }
+        int holder = reserved[p.y][p.x];
+        if ((holder != -1 && holder != idx) || is_occupied(p.x, p.y, idx)) break;
+        reserved[p.y][p.x] = idx;
+        a->held[a->held_count++] = p;
     }
-    return -1;
+    return a->held_count > 0;
+}
+int find_wait_root(int i) {
+    while (wait_root[i] != i) {
+        wait_root[i] = wait_root[wait_root[i]];
+        i = wait_root[i];
+    }
+    return i;
+}
+// Record that agent i waits for agent j this timestep. i has no outgoing edge yet, so it is the
+// root of its waiting tree and the new edge closes a cycle exactly when j is in the same tree.
+void wait_on(int i, int j) {
+    waits_for[i] = j;
+    int ri = find_wait_root(i), rj = find_wait_root(j);
+    if (ri != rj) {
+        wait_root[ri] = rj;
+        return;
+    }
+    int n = 0;
+    for (int k = j; k != i; k = waits_for[k])
+        cycles[cycle_count][n++] = k;
+    cycles[cycle_count][n++] = i;
+    cycle_len[cycle_count++] = n;
+}
+// Whether p lies ahead of any of the given agents other than `exclude`
+bool in_way_of(Point p, const int *members, int n, int exclude) {
+    for (int k = 0; k < n; ++k) {
+        Agent *m = &agents[members[k]];
+        if (members[k] == exclude) continue;
+        Point next;
+        if (next_step(members[k], &next) && next.x == p.x && next.y == p.y) return true;
+        for (int r = m->route_pos + 1; r < m->route_len; ++r)
+            if (m->route[r].x == p.x && m->route[r].y == p.y) return true;
+    }
+    return false;
 }
 // Deadlock resolution by moving to least crowded valid cell
-void resolve_deadlock(int agent_idx) {
+bool resolve_deadlock(int agent_idx) {
     Agent *a = &agents[agent_idx];
     int best_dir = -1, best_score = INT_MIN;
 
@@ -162,86 +697,396 @@ void resolve_deadlock(int agent_idx) {
         }
     }
 
-    if (best_dir != -1) {
-        int x = a->pos.x, y = a->pos.y;
-        density[y][x]--;
-        a->pos.x += dx[best_dir];
-        a->pos.y += dy[best_dir];
-        density[a->pos.y][a->pos.x]++;
+    if (best_dir == -1) return false;
+    move_agent(agent_idx, (Point){a->pos.x + dx[best_dir], a->pos.y + dy[best_dir]});
+    return true;
+}
+// Breadth-first search over free cells for the nearest one within PARK_RADIUS that is out of the
+// way of the other agents in a deadlock. Returns its distance, or -1 if there is none.
+int find_parking(int idx, const int *members, int n, Point *spot) {
+    static int seen[MAX_MAP][MAX_MAP], stamp = 0;
+    static Point queue[MAX_MAP * MAX_MAP];
+    static int dist[MAX_MAP * MAX_MAP];
+    int head = 0, tail = 0;
+    if (stamp == INT_MAX) {
+        memset(seen, 0, sizeof(seen));
+        stamp = 0;
     }
+    stamp++;
+    queue[tail] = agents[idx].pos;
+    dist[tail++] = 0;
+    seen[agents[idx].pos.y][agents[idx].pos.x] = stamp;
+    while (head < tail) {
+        Point p = queue[head];
+        int d = dist[head++];
+        if (d > 0 && !in_way_of(p, members, n, idx)) {
+            *spot = p;
+            return d;
+        }
+        if (d == PARK_RADIUS) continue;
+        for (int dir = 0; dir < 4; ++dir) {
+            if (!(flow[p.y][p.x] & MOVE_OPEN(dir))) continue;
+            int nx = p.x + dx[dir], ny = p.y + dy[dir];
+            if (seen[ny][nx] == stamp || is_occupied(nx, ny, idx)) continue;
+            seen[ny][nx] = stamp;
+            queue[tail] = (Point){nx, ny};
+            dist[tail++] = d + 1;
+        }
+    }
+    return -1;
 }
-// Simulate all agents step-by-step until all reach goals
-void simulate() {
-    bool changed;
-    int timestep = 0;
-    visualize_with_timestep(timestep); // Initial state
-    do {
-        changed = false;
-
-        for (int i = 0; i < agent_count; ++i) {
-            if (agents[i].done) continue;
-
-            Node *path = a_star(&agents[i]);
-            if (!path) continue;
+// Mark an agent that just moved as finished if it stands on its goal
+void check_finished(int idx, int timestep) {
+    Agent *a = &agents[idx];
+    if (a->pos.x == a->goal.x && a->pos.y == a->goal.y) {
+        a->done = true;
+        release_reservations(idx);
+        makespan = timestep;
+        if (verbose) printf("Agent %c finished at timestep %d\n", a->id, timestep);
+    }
+}
+// Break a deadlock cycle. When every agent wants the cell of the next one and there are at least
+// three of them, they all shift one cell around the cycle. Otherwise the others replan and the
+// agent closest to a cell out of their way drives there and parks for PARK_HOLD timesteps; if no
+// such cell exists one agent just sidesteps. Boosted agents never give way.
+void break_cycle(const int *members, int n, int timestep) {
+    deadlocks_broken++;
+    Point target[MAX_AGENTS];
+    bool rotate = n >= 3;
+    for (int k = 0; k < n && rotate; ++k) {
+        Point next;
+        int after = members[(k + 1) % n];
+        rotate = next_step(members[k], &next) && next.x == agents[after].pos.x && next.y == agents[after].pos.y;
+        target[k] = next;
+    }
+    if (rotate) {
+        for (int k = 0; k < n; ++k) {
+            Agent *a = &agents[members[k]];
+            occupant[a->pos.y][a->pos.x] = -1;
+            density[a->pos.y][a->pos.x]--;
+        }
+        for (int k = 0; k < n; ++k) {
+            Agent *a = &agents[members[k]];
+            a->pos = target[k];
+            a->route_pos++;
+            occupant[a->pos.y][a->pos.x] = members[k];
+            density[a->pos.y][a->pos.x]++;
+            release_reservations(members[k]);
+            check_finished(members[k], timestep);
+        }
+        return;
+    }
 
-            Node *step = path;
-            while (step->parent && step->parent->parent) step = step->parent;
+    for (int k = 0; k < n; ++k) {
+        release_reservations(members[k]);
+        plan_route(members[k]);
+    }
+    int yielder = -1, best = INT_MAX;
+    Point spot, park;
+    for (int k = 0; k < n; ++k) {
+        if (agents[members[k]].escalation >= ESCALATE_BOOST) continue;
+        int d = find_parking(members[k], members, n, &spot);
+        if (d != -1 && d < best) {
+            best = d;
+            yielder = members[k];
+            park = spot;
+        }
+    }
+    if (yielder != -1) {
+        Node *path = a_star(&agents[yielder], park, AVOID_ALL);
+        if (path && store_route(&agents[yielder], path, -1)) {
+            agents[yielder].hold = PARK_HOLD;
+            return;
+        }
+    }
+    for (int k = 0; k < n; ++k)
+        if (agents[members[k]].escalation < ESCALATE_BOOST && resolve_deadlock(members[k])) {
+            plan_route(members[k]);
+            return;
+        }
+}
+// Distance to the goal along the flow graph, the progress measure of stall detection
+int goal_distance(int idx) {
+    Agent *a = &agents[idx];
+    if (!a->field || a->field->epoch != flow_epoch) a->field = field_for(a->goal);
+    if (!a->field) return heuristic(a->pos, a->goal);
+    return a->field->dist[a->pos.y][a->pos.x];
+}
+// FNV-1a hash of where every agent is and how long parked agents still wait
+uint64_t state_hash() {
+    uint64_t h = 1469598103934665603ULL;
+    for (int i = 0; i < agent_count; ++i) {
+        int v[3] = {agents[i].pos.x, agents[i].pos.y, agents[i].hold};
+        for (int k = 0; k < 3; ++k) {
+            h ^= (uint64_t)v[k];
+            h *= 1099511628211ULL;
+        }
+    }
+    return h;
+}
+// Whether the current state already occurred within the window with no agent getting closer to
+// its goal since, i.e. the agents go round in circles. Records the state either way.
+bool detect_livelock() {
+    uint64_t h = state_hash();
+    bool repeated = false;
+    int window = state_count < LIVELOCK_WINDOW ? state_count : LIVELOCK_WINDOW;
+    for (int k = 0; k < window && !repeated; ++k)
+        repeated = state_history[k] == h && state_progress[k] == progress_count;
+    state_history[state_count % LIVELOCK_WINDOW] = h;
+    state_progress[state_count % LIVELOCK_WINDOW] = progress_count;
+    if (++state_count == 2 * LIVELOCK_WINDOW) state_count = LIVELOCK_WINDOW;
+    return repeated;
+}
+// Move an agent to the front of the moving order
+void boost_priority(int idx) {
+    int k = 0;
+    while (order[k] != idx) k++;
+    for (; k > 0; --k) order[k] = order[k - 1];
+    order[0] = idx;
+}
+// Update each agent's progress and escalate the ones that stalled: after STALL_STEPS without
+// getting closer, or as soon as the agents are caught in a livelock, a stalled agent replans, then
+// gets priority as well, and gives up once no agent at all has got closer for STALL_STEPS; until
+// then it keeps replanning with priority. Returns false once an agent gives up.
+bool track_progress(int timestep) {
+    for (int i = 0; i < agent_count; ++i) {
+        Agent *a = &agents[i];
+        if (a->done) continue;
+        int d = goal_distance(i);
+        if (d < a->best_dist) {
+            a->best_dist = d;
+            a->last_progress = timestep;
+            a->escalation = ESCALATE_NONE;
+            last_any_progress = timestep;
+            progress_count++;
+        }
+    }
+    bool livelock = detect_livelock();
+    for (int i = 0; i < agent_count; ++i) {
+        Agent *a = &agents[i];
+        if (a->done || a->last_progress == timestep) continue;
+        int since = timestep - (a->escalated_at > a->last_progress ? a->escalated_at : a->last_progress);
+        if (since < STALL_STEPS && !(livelock && a->escalated_at < timestep - 1)) continue;
+        a->escalated_at = timestep;
+        if (a->escalation == ESCALATE_BOOST && timestep - last_any_progress >= STALL_STEPS) {
+            a->escalation = ESCALATE_GIVE_UP;
+            return false;
+        }
+        if (a->escalation < ESCALATE_BOOST) a->escalation++;
+        release_reservations(i);
+        a->hold = 0;
+        plan_route(i);
+        if (a->escalation == ESCALATE_BOOST) boost_priority(i);
+    }
+    return true;
+}
+// Record every agent still on its way when the simulation gives up
+void record_stalls() {
+    stall_count = 0;
+    for (int i = 0; i < agent_count; ++i) {
+        if (agents[i].done) continue;
+        stalls[stall_count++] = (StallRecord){i, agents[i].pos, goal_distance(i), agents[i].best_dist,
+                                              agents[i].last_progress, waits_for[i]};
+    }
+}
+// Cell an agent wants to move to this timestep, optionally repairing its route around agents in
+// the way. Returns false if it stays put.
+bool propose_step(int i, Point *next, bool repair) {
+    Agent *a = &agents[i];
+    if (a->done) return false;
+    // Parked agents let the others pass before heading for their goal again
+    if (a->hold > 0 && a->route_pos + 1 >= a->route_len) {
+        a->hold--;
+        return false;
+    }
+    // Follow the planned route; repair it locally only where it is blocked
+    if (!next_step(i, next)) return false;
+    if (repair && a->route_len > 0 && is_occupied(next->x, next->y, i) && repair_route(i))
+        next_step(i, next);
+    return next->x != a->pos.x || next->y != a->pos.y;
+}
+// One timestep with agents moving one after the other in priority order, each seeing the moves
+// made before it
+void step_serial(int timestep) {
+    for (int k = 0; k < agent_count; ++k) {
+        int i = order[k];
+        Point next;
+        if (!propose_step(i, &next, true)) continue;
+        // Still blocked or reserved by someone else: wait on whoever is in the way
+        if (!reserve_ahead(i, next)) {
+            int blocker = agent_at(next.x, next.y, i);
+            if (blocker == -1) blocker = reserved[next.y][next.x];
+            if (blocker != -1 && !agents[blocker].done) wait_on(i, blocker);
+            continue;
+        }
+        // Perform move
+        move_agent(i, next);
+        agents[i].route_pos++;
+        check_finished(i, timestep + 1);
+    }
+}
+#if PARALLEL_STEP
+// Two-phase timestep. In phase one every agent picks its next cell against the positions at the
+// start of the timestep, in parallel, and claims it in a lock-free array where the agent earliest
+// in `order` wins. Phase two commits the claims serially, so the outcome does not depend on how
+// the threads were scheduled.
+Point proposal[MAX_AGENTS];
+bool proposing[MAX_AGENTS];
+_Atomic int claim[MAX_MAP][MAX_MAP]; // Best rank in `order` claiming each cell, INT_MAX if none
+pthread_t step_threads[STEP_THREADS];
+pthread_barrier_t step_start, step_done;
+bool step_stop = false;
 
-            // Warning checks
-            for (int j = 0; j < agent_count; ++j) {
-                if (i != j && agents[j].pos.x == step->pt.x && agents[j].pos.y == step->pt.y && !agents[j].done) {
-                    printf("Warning: Agent %c is trying to move to a position occupied by Agent %c at timestep %d\n",
-                        agents[i].id, agents[j].id, timestep + 1);
-                }
-            }
-            for (int j = 0; j < agent_count; ++j) {
-                if (i != j && agents[j].pos.x == step->pt.x && agents[j].pos.y == step->pt.y && agents[j].done) {
-                    printf("Warning: Agent %c is moving over the goal position of finished Agent %c at timestep %d\n",
-                        agents[i].id, agents[j].id, timestep + 1);
-                }
-            }
-            // No movement needed
-            if (step->pt.x == agents[i].pos.x && step->pt.y == agents[i].pos.y)
-                continue;
-            // Detect potential deadlock
-            int target_idx = -1;
-            for (int j = 0; j < agent_count; ++j)
-                if (i != j && agents[j].pos.x == step->pt.x && agents[j].pos.y == step->pt.y && !agents[j].done)
-                    target_idx = j;
+// Phase one for the agents at ranks thread, thread + STEP_THREADS, ... Routes are not repaired
+// here: agents blocking each other would all see the same snapshot and dodge the same way at
+// once. They wait on each other instead, and deadlock breaking sorts them out serially.
+void propose_moves(int thread) {
+    for (int k = thread; k < agent_count; k += STEP_THREADS) {
+        int i = order[k];
+        proposing[i] = propose_step(i, &proposal[i], false);
+        if (!proposing[i]) continue;
+        _Atomic int *c = &claim[proposal[i].y][proposal[i].x];
+        int best = atomic_load(c);
+        while (k < best && !atomic_compare_exchange_weak(c, &best, k));
+    }
+}
+void *step_worker(void *arg) {
+    int thread = (int)(intptr_t)arg;
+    for (;;) {
+        pthread_barrier_wait(&step_start);
+        if (step_stop) break;
+        propose_moves(thread);
+        pthread_barrier_wait(&step_done);
+    }
+    free(search_cells);
+    free(open_heap);
+    free(path_arena);
+    return NULL;
+}
+void start_step_threads() {
+    for (int y = 0; y < MAX_MAP; ++y)
+        for (int x = 0; x < MAX_MAP; ++x)
+            atomic_init(&claim[y][x], INT_MAX);
+    step_stop = false;
+    pthread_barrier_init(&step_start, NULL, STEP_THREADS);
+    pthread_barrier_init(&step_done, NULL, STEP_THREADS);
+    for (int t = 1; t < STEP_THREADS; ++t)
+        pthread_create(&step_threads[t], NULL, step_worker, (void *)(intptr_t)t);
+}
+void stop_step_threads() {
+    step_stop = true;
+    pthread_barrier_wait(&step_start);
+    for (int t = 1; t < STEP_THREADS; ++t)
+        pthread_join(step_threads[t], NULL);
+    pthread_barrier_destroy(&step_start);
+    pthread_barrier_destroy(&step_done);
+}
+// Whether agent i's move goes through: it won the claim on its cell, and the cell is empty or its
+// occupant moves on. Agents following each other round a cycle all stay and are left to deadlock
+// breaking. state[] is 0 unresolved, 1 being resolved, 2 moves, 3 stays.
+bool commits(int i, int *state) {
+    if (state[i] != 0) return state[i] == 2;
+    state[i] = 1;
+    Point c = proposal[i];
+    bool ok = proposing[i] && order[atomic_load(&claim[c.y][c.x])] == i;
+    int o = ok ? occupant[c.y][c.x] : -1;
+    if (o != -1) ok = commits(o, state);
+    state[i] = ok ? 2 : 3;
+    return ok;
+}
+void step_parallel(int timestep) {
+    // Fields are shared between agents, so compute any stale ones before the threads read them
+    for (int i = 0; i < agent_count; ++i)
+        if (!agents[i].done) goal_distance(i);
+    pthread_barrier_wait(&step_start);
+    propose_moves(0);
+    pthread_barrier_wait(&step_done);
 
-            if (target_idx != -1) {
-                bool visited[MAX_AGENTS] = {false};
-                int cycle = find_blocking_chain(i, visited);
-                if (cycle != -1) {
-                    resolve_deadlock(cycle);
-                    while (path) {
-                        Node *prev = path;
-                        path = path->parent;
-                        free(prev);
-                    }
-                    continue;
-                }
-            }
-            // Perform move
-            density[agents[i].pos.y][agents[i].pos.x]--;
-            agents[i].pos = step->pt;
-            density[agents[i].pos.y][agents[i].pos.x]++;
-            if (agents[i].pos.x == agents[i].goal.x && agents[i].pos.y == agents[i].goal.y) {
-                agents[i].done = true;
-                printf("Agent %c finished at timestep %d\n", agents[i].id, timestep + 1);
-            }
-            changed = true;
-            // Free path memory
-            while (path) {
-                Node *prev = path;
-                path = path->parent;
-                free(prev);
-            }
+    int state[MAX_AGENTS] = {0};
+    for (int k = 0; k < agent_count; ++k)
+        commits(order[k], state);
+    for (int i = 0; i < agent_count; ++i) {
+        if (state[i] != 2) continue;
+        occupant[agents[i].pos.y][agents[i].pos.x] = -1;
+        density[agents[i].pos.y][agents[i].pos.x]--;
+    }
+    for (int k = 0; k < agent_count; ++k) {
+        int i = order[k];
+        if (!proposing[i]) continue;
+        Point c = proposal[i];
+        if (state[i] == 2) {
+            agents[i].pos = c;
+            agents[i].route_pos++;
+            occupant[c.y][c.x] = i;
+            density[c.y][c.x]++;
+            check_finished(i, timestep + 1);
+        } else {
+            // Wait on the agent that won the cell, or on the one that did not leave it
+            int winner = order[atomic_load(&claim[c.y][c.x])];
+            int blocker = winner != i ? winner : agent_at(c.x, c.y, i);
+            if (blocker != -1 && !agents[blocker].done) wait_on(i, blocker);
         }
+    }
+    for (int i = 0; i < agent_count; ++i)
+        if (proposing[i]) atomic_store(&claim[proposal[i].y][proposal[i].x], INT_MAX);
+}
+#endif
+// Move every agent one timestep and break the deadlocks found on the way, smallest cycle first
+void advance(int timestep) {
+    cycle_count = 0;
+    for (int i = 0; i < agent_count; ++i) {
+        waits_for[i] = -1;
+        wait_root[i] = i;
+    }
+
+#if PARALLEL_STEP
+    step_parallel(timestep);
+#else
+    step_serial(timestep);
+#endif
 
+    while (cycle_count > 0) {
+        int smallest = 0;
+        for (int c = 1; c < cycle_count; ++c)
+            if (cycle_len[c] < cycle_len[smallest]) smallest = c;
+        break_cycle(cycles[smallest], cycle_len[smallest], timestep + 1);
+        cycle_count--;
+        memcpy(cycles[smallest], cycles[cycle_count], sizeof(cycles[0]));
+        cycle_len[smallest] = cycle_len[cycle_count];
+    }
+    update_congestion();
+}
+// Simulate all agents step-by-step until all reach goals, or until stalled agents give up.
+// Returns whether every agent finished.
+bool simulate() {
+    int timestep = 0;
+    int remaining = 0;
+    for (int i = 0; i < agent_count; ++i) {
+        order[i] = i;
+        agents[i].best_dist = goal_distance(i);
+        if (!agents[i].done) remaining++;
+    }
+    visualize_with_timestep(timestep); // Initial state
+#if PARALLEL_STEP
+    start_step_threads();
+#endif
+    while (remaining > 0) {
+        advance(timestep);
         timestep++;
         visualize_with_timestep(timestep);
-    } while (changed); // Repeat until no agent moves
+        remaining = 0;
+        for (int i = 0; i < agent_count; ++i)
+            if (!agents[i].done) remaining++;
+        if (remaining > 0 && !track_progress(timestep)) {
+            record_stalls();
+            break;
+        }
+    }
+#if PARALLEL_STEP
+    stop_step_threads();
+#endif
+    timesteps_run = timestep;
+    return remaining == 0;
 }
 // Map initialization
 void setup_map() {
@@ -261,22 +1106,257 @@ void setup_map() {
 }
 // Initialize agents with positions and goals
 void setup_agents() {
-    agents[0] = (Agent){'A', {1, 1}, {6, 6}, {1, 1}, false};
-    agents[1] = (Agent){'B', {1, 5}, {6, 0}, {1, 5}, false};
-    agents[2] = (Agent){'C', {5, 1}, {0, 6}, {5, 1}, false};
-    agents[3] = (Agent){'D', {5, 5}, {0, 0}, {5, 5}, false};
-    agents[4] = (Agent){'E', {3, 3}, {3, 0}, {3, 3}, false};
+    agents[0] = (Agent){.id = 'A', .start = {1, 1}, .goal = {6, 6}, .pos = {1, 1}, .done = false};
+    agents[1] = (Agent){.id = 'B', .start = {1, 5}, .goal = {6, 0}, .pos = {1, 5}, .done = false};
+    agents[2] = (Agent){.id = 'C', .start = {5, 1}, .goal = {0, 6}, .pos = {5, 1}, .done = false};
+    agents[3] = (Agent){.id = 'D', .start = {5, 5}, .goal = {0, 0}, .pos = {5, 5}, .done = false};
+    agents[4] = (Agent){.id = 'E', .start = {3, 3}, .goal = {3, 0}, .pos = {3, 3}, .done = false};
     agent_count = 5;
     // Update congestion density
     for (int i = 0; i < agent_count; ++i)
         density[agents[i].pos.y][agents[i].pos.x]++;
 }
 
+#ifdef FAR_BENCHMARK
+// A* throughput on large pillar warehouses. Needs -DMAX_MAP=256.
+void benchmark_search(int size, int searches) {
+    height = width = size;
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+            map[y][x] = (x % 2 == 1 && y % 2 == 1) ? '#' : '.';
+    build_flow_graph();
+    agent_count = 1;
+    index_agents();
+
+    srand(1);
+    long long before = expansions;
+    int found = 0;
+    clock_t start = clock();
+    for (int i = 0; i < searches; i++) {
+        Point from, to;
+        do from = (Point){rand() % width, rand() % height}; while (!is_valid(from.x, from.y));
+        do to = (Point){rand() % width, rand() % height}; while (!is_valid(to.x, to.y));
+        agents[0].pos = from;
+        Node *path = a_star(&agents[0], to, AVOID_NONE);
+        if (path) found++;
+    }
+    double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    long long expanded = expansions - before;
+    printf("%dx%d: %d/%d searches, %lld expansions in %.3f s, %.0f expansions/s\n",
+        size, size, found, searches, expanded, seconds, expanded / (seconds > 0 ? seconds : 1e-9));
+}
+
+// Whether an agent can still reach its goal when every other agent already sits on its own
+bool goal_reachable(int idx) {
+    static Point queue[MAX_MAP * MAX_MAP];
+    static bool seen[MAX_MAP][MAX_MAP];
+    memset(seen, 0, sizeof(seen));
+    for (int j = 0; j < agent_count; ++j)
+        if (j != idx) seen[agents[j].goal.y][agents[j].goal.x] = true;
+    Point goal = agents[idx].goal;
+    int head = 0, tail = 0;
+    seen[agents[idx].start.y][agents[idx].start.x] = true;
+    queue[tail++] = agents[idx].start;
+    while (head < tail) {
+        Point p = queue[head++];
+        if (p.x == goal.x && p.y == goal.y) return true;
+        for (int d = 0; d < 4; ++d) {
+            int nx = p.x + dx[d], ny = p.y + dy[d];
+            if (!is_valid(nx, ny) || seen[ny][nx]) continue;
+            seen[ny][nx] = true;
+            queue[tail++] = (Point){nx, ny};
+        }
+    }
+    return false;
+}
+// Load a crowded pillar warehouse like the ones in "crowded env": every agent starts on a pillar
+// and heads for a random cell on the edge, not next to another goal. Goal sets where finished
+// agents would wall someone in, such as two goals sealing a corner, are drawn again.
+void load_crowded(int size, int count, unsigned seed) {
+    height = width = size;
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+            map[y][x] = (x % 2 == 1 && y % 2 == 1) ? '#' : '.';
+    build_flow_graph();
+    field_count = 0;
+    srand(seed);
+    memset(agents, 0, sizeof(agents));
+    memset(density, 0, sizeof(density));
+    agent_count = 0;
+    for (int y = 1; y < height && agent_count < count; y += 2)
+        for (int x = 1; x < width && agent_count < count; x += 2) {
+            Agent *a = &agents[agent_count];
+            a->id = 'A' + agent_count;
+            a->start = a->pos = (Point){x, y};
+            density[y][x]++;
+            agent_count++;
+        }
+    // Draw goals one by one, starting over when the edge runs out of room or a goal is walled in
+    for (bool reachable = false; !reachable;) {
+        for (int i = 0, tries = 0; i < agent_count; ++tries) {
+            if (tries > 100) i = tries = 0;
+            int side = rand() % 4, along = rand() % size;
+            Point goal = {side < 2 ? along : (side == 2 ? 0 : size - 1),
+                          side >= 2 ? along : (side == 0 ? 0 : size - 1)};
+            bool taken = false;
+            for (int j = 0; j < i && !taken; ++j)
+                taken = heuristic(agents[j].goal, goal) <= 1;
+            if (taken) continue;
+            agents[i++].goal = goal;
+            tries = 0;
+        }
+        reachable = true;
+        for (int i = 0; i < agent_count && reachable; ++i)
+            reachable = goal_reachable(i);
+    }
+    index_agents();
+    memset(heat, 0, sizeof(heat));
+    memset(heat_stamp, 0, sizeof(heat_stamp));
+    heat_now = 0;
+    state_count = progress_count = last_any_progress = 0;
+    deadlocks_broken = 0;
+    makespan = 0;
+}
+// Deadlocks broken and makespan on crowded layouts with and without congestion-aware costs
+void benchmark_congestion(int size, int count, int instances) {
+    for (int mode = 0; mode < 2; ++mode) {
+        use_congestion = mode;
+        int solved = 0;
+        long long deadlocks = 0, total_makespan = 0;
+        for (int i = 0; i < instances; ++i) {
+            load_crowded(size, count, i + 1);
+            if (simulate()) {
+                solved++;
+                total_makespan += makespan;
+            }
+            deadlocks += deadlocks_broken;
+        }
+        printf("%dx%d crowded, %d agents, congestion %s: %d/%d solved, %.2f deadlocks broken, makespan %.2f\n",
+            size, size, agent_count, mode ? "on " : "off", solved, instances, (double)deadlocks / instances,
+            solved ? (double)total_makespan / solved : 0.0);
+    }
+    use_congestion = USE_CONGESTION;
+}
+
+// Peak resident set size in kB
+long peak_rss_kb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+// Give an agent that just arrived a new goal: a random free cell nobody else is heading for
+void assign_goal(int idx, int timestep) {
+    Agent *a = &agents[idx];
+    Point goal;
+    bool taken;
+    do {
+        goal = (Point){rand() % width, rand() % height};
+        taken = !is_valid(goal.x, goal.y) || (goal.x == a->pos.x && goal.y == a->pos.y);
+        for (int j = 0; j < agent_count && !taken; ++j)
+            taken = agents[j].goal.x == goal.x && agents[j].goal.y == goal.y;
+    } while (taken);
+    a->goal = goal;
+    a->done = false;
+    a->field = NULL;
+    a->route_len = 0;
+    a->hold = 0;
+    a->escalation = ESCALATE_NONE;
+    a->best_dist = goal_distance(idx);
+    a->last_progress = timestep;
+}
+// Lifelong soak: one crowded instance runs for `timesteps`, every agent getting a new goal as it
+// arrives, so nothing is reset between goals. The search and congestion clocks start close to
+// their limit so that they wrap during the run. Checks that the path arena, the livelock history
+// and the flow fields stay within their bounds and that agents keep arriving to the end.
+bool benchmark_soak(long timesteps) {
+    load_crowded(9, 12, 1);
+    for (int i = 0; i < agent_count; ++i) {
+        order[i] = i;
+        agents[i].best_dist = goal_distance(i);
+    }
+    plan_route(0); // Sizes the search scratch space before the clock is moved
+    search_id = INT_MAX - (int)timesteps;
+    heat_now = UINT_MAX - (unsigned)timesteps / 2;
+    search_wraps = arena_peak = 0;
+#if PARALLEL_STEP
+    start_step_threads();
+#endif
+    long arrivals = 0, last_arrivals = 0, give_ups = 0, period = timesteps / 10;
+    bool ok = true;
+    clock_t start = clock();
+    for (int t = 0; t < timesteps;) {
+        advance(t);
+        t++;
+        for (int i = 0; i < agent_count; ++i)
+            if (agents[i].done) {
+                assign_goal(i, t);
+                arrivals++;
+            }
+        // Agents that gave up drop their task and get a new goal, as a warehouse would reassign it
+        if (!track_progress(t)) {
+            record_stalls();
+            for (int k = 0; k < stall_count; ++k)
+                assign_goal(stalls[k].agent, t);
+            give_ups += stall_count;
+            last_any_progress = t;
+        }
+        if (t % period == 0) {
+            int fieldless = 0;
+            for (int i = 0; i < agent_count; ++i)
+                if (!field_for(agents[i].goal)) fieldless++;
+            printf("soak: %d timesteps, %ld arrivals (+%ld), %ld give-ups, arena peak %d of %d nodes, "
+                "%d states held, %d fields, %d search wraps, peak RSS %ld kB\n", t, arrivals,
+                arrivals - last_arrivals, give_ups, arena_peak, width * height,
+                state_count < LIVELOCK_WINDOW ? state_count : LIVELOCK_WINDOW, field_count, search_wraps,
+                peak_rss_kb());
+            if (arrivals == last_arrivals || arena_peak > width * height || state_count >= 2 * LIVELOCK_WINDOW ||
+                field_count > MAX_FIELDS || fieldless > 0)
+                ok = false;
+            last_arrivals = arrivals;
+        }
+    }
+#if PARALLEL_STEP
+    stop_step_threads();
+#endif
+    // Both clocks must have wrapped and kept working
+    if (search_wraps == 0 || heat_now > (unsigned)timesteps) ok = false;
+    printf("soak: %s in %.2f s\n", ok ? "bounded" : "FAILED", (double)(clock() - start) / CLOCKS_PER_SEC);
+    return ok;
+}
+
+int main() {
+    verbose = false;
+    benchmark_congestion(7, 9, 200);
+    benchmark_congestion(9, 12, 200);
+    benchmark_congestion(11, 16, 200);
+    if (!benchmark_soak(100000)) return 1;
+    if (MAX_MAP < 256) {
+        printf("Rebuild with -DMAX_MAP=256 to benchmark 256x256 maps\n");
+        return 0;
+    }
+    benchmark_search(64, 2000);
+    benchmark_search(256, 200);
+    return 0;
+}
+#else
 int main() {
     setup_map();
+    build_flow_graph();
     setup_agents();
+    index_agents();
     visualize_with_timestep(0);
-    simulate();
-    printf("All agents reached their goals.\n");
-    return 0;
+    if (simulate()) {
+        printf("All agents reached their goals.\n");
+        return 0;
+    }
+    printf("Gave up with %d agents stuck:\n", stall_count);
+    for (int k = 0; k < stall_count; ++k) {
+        StallRecord *r = &stalls[k];
+        printf("  Agent %c at (%d, %d), distance %d, best %d since timestep %d", agents[r->agent].id,
+               r->pos.x, r->pos.y, r->dist, r->best_dist, r->last_progress);
+        if (r->waiting_on != -1) printf(", waiting on %c", agents[r->waiting_on].id);
+        putchar('\n');
+    }
+    return 1;
 }
+#endif
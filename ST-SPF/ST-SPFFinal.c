@@ -3,11 +3,28 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "../common/reservation_table.h" // Link with common/reservation_table.c
 
 #define MAX_AGENTS 26
 #define MAX_TIME 100
 #define MAX_GRID 50
 
+// Anytime large neighborhood search (LNS) over the sequential solution
+#define LNS_TIME_BUDGET_MS 500 // Wall-clock budget for improving the plan (0 disables LNS)
+#define LNS_NEIGHBORHOOD 3     // Agents removed and replanned per iteration
+#define LNS_SEED 1
+#define LNS_REACTION 0.1       // How quickly neighborhood weights follow recent gains
+#define LNS_STALL_LIMIT 200    // Give up after this many iterations in a row without a gain
+
+// Ways of choosing the agents to replan
+#define NEIGHBORHOOD_RANDOM 0     // Any agents
+#define NEIGHBORHOOD_CONGESTION 1 // Agents passing near a busy cell
+#define NEIGHBORHOOD_DELAY 2      // Agents furthest behind their shortest path
+#define NEIGHBORHOOD_COUNT 3
+
 typedef struct {
     int x, y;
 } Pos;
@@ -29,8 +46,8 @@ int width = 10, height = 10, agent_count = 0;
 char map[MAX_GRID][MAX_GRID];
 Agent agents[MAX_AGENTS];
 
-// Space-time occupancy: [time][row][col]
-char occupancy[MAX_TIME][MAX_GRID][MAX_GRID];
+// Space-time occupancy: id of the agent in each cell (row * width + col) at each time
+ReservationTable occupancy;
 
 // Directions (up, right, down, left, wait)
 int dx[] = {-1, 0, 1, 0, 0};
@@ -67,12 +84,12 @@ bool is_free(int t, int x, int y) {
 // Improved swap conflict check: prevent two agents from swapping positions at the same timestep
 bool is_swap_conflict(int t, int from_x, int from_y, int to_x, int to_y) {
     if (t <= 0 || t >= MAX_TIME) return false;
-    char prev = occupancy[t-1][to_x][to_y];
-    // Only check if the previous cell was occupied by an agent (not wall or empty)
-    if (prev != '.' && prev != '#' && prev != occupancy[t][to_x][to_y]) {
+    int prev = rt_get(&occupancy, to_x * width + to_y, t - 1);
+    // Only check if the previous cell was occupied by an agent
+    if (prev != 0 && prev != rt_get(&occupancy, to_x * width + to_y, t)) {
         // Check if that agent is moving to our current cell at this timestep
         // That is, at time t, is the agent that was at (to_x, to_y) now at (from_x, from_y)?
-        if (occupancy[t][from_x][from_y] == prev) {
+        if (rt_get(&occupancy, from_x * width + from_y, t) == prev) {
             return true;
         }
     }
@@ -82,13 +99,23 @@ bool is_swap_conflict(int t, int from_x, int from_y, int to_x, int to_y) {
 void set_occupancy(Agent *a) {
     for (int t = 0; t < a->path_len; t++) {
         Pos p = a->path[t];
-        occupancy[t][p.x][p.y] = a->id;
+        rt_set(&occupancy, p.x * width + p.y, t, a->id);
     }
-    // Block goal cell after arrival with agent's ID (not '#')
+    // Block goal cell after arrival with agent's ID
     Pos g = a->path[a->path_len - 1];
     for (int t = a->path_len; t < MAX_TIME; t++) {
-        occupancy[t][g.x][g.y] = a->id;
+        rt_set(&occupancy, g.x * width + g.y, t, a->id);
+    }
+}
+
+// An agent may only stop at its goal if nobody passes through it afterwards
+bool goal_stays_free(Agent *a, int t) {
+    for (; t < MAX_TIME; t++) {
+        int occupant = rt_get(&occupancy, a->goal.x * width + a->goal.y, t);
+        if (occupant != 0 && occupant != a->id)
+            return false;
     }
+    return true;
 }
 
 bool bfs(Agent *a) {
@@ -107,7 +134,7 @@ bool bfs(Agent *a) {
 
     while (front < rear) {
         QueueNode curr = queue[front++];
-        if (curr.pos.x == a->goal.x && curr.pos.y == a->goal.y) {
+        if (curr.pos.x == a->goal.x && curr.pos.y == a->goal.y && goal_stays_free(a, curr.time + 1)) {
             // Reconstruct path
             a->path_len = curr.time + 1;
             for (int t = curr.time; t >= 0; t--) {
@@ -134,6 +161,220 @@ bool bfs(Agent *a) {
     return false;
 }
 
+// Removes an agent's path (and its parked goal) from the occupancy table
+void clear_occupancy(Agent *a) {
+    if (a->path_len == 0) return;
+    for (int t = 0; t < MAX_TIME; t++) {
+        Pos p = (t < a->path_len) ? a->path[t] : a->path[a->path_len - 1];
+        if (rt_get(&occupancy, p.x * width + p.y, t) == a->id)
+            rt_set(&occupancy, p.x * width + p.y, t, 0);
+    }
+}
+
+int sum_of_costs() {
+    int sum = 0;
+    for (int i = 0; i < agent_count; i++)
+        sum += agents[i].path_len - 1;
+    return sum;
+}
+
+int makespan() {
+    int longest = 0;
+    for (int i = 0; i < agent_count; i++)
+        if (agents[i].path_len - 1 > longest)
+            longest = agents[i].path_len - 1;
+    return longest;
+}
+
+double elapsed_ms(struct timespec since) {
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (now.tv_sec - since.tv_sec) * 1000.0 + (now.tv_nsec - since.tv_nsec) / 1e6;
+}
+
+// Shortest path length on the static map, ignoring other agents
+int static_distance(Pos from, Pos to) {
+    static int dist[MAX_GRID][MAX_GRID];
+    static Pos cells[MAX_GRID * MAX_GRID];
+    for (int i = 0; i < height; i++)
+        for (int j = 0; j < width; j++)
+            dist[i][j] = -1;
+    int front = 0, rear = 0;
+    cells[rear++] = from;
+    dist[from.x][from.y] = 0;
+    while (front < rear) {
+        Pos p = cells[front++];
+        if (p.x == to.x && p.y == to.y) return dist[p.x][p.y];
+        for (int d = 0; d < 4; d++) {
+            int nx = p.x + dx[d], ny = p.y + dy[d];
+            if (!is_valid(nx, ny) || dist[nx][ny] >= 0) continue;
+            dist[nx][ny] = dist[p.x][p.y] + 1;
+            cells[rear++] = (Pos){nx, ny};
+        }
+    }
+    return -1;
+}
+
+void shuffle(int *items, int n) {
+    for (int i = n - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        int tmp = items[i];
+        items[i] = items[j];
+        items[j] = tmp;
+    }
+}
+
+// Picks the n agents with the smallest scores, breaking ties randomly
+int pick_lowest(const int *score, int *group, int n) {
+    int order[MAX_AGENTS];
+    for (int i = 0; i < agent_count; i++) order[i] = i;
+    shuffle(order, agent_count);
+    for (int i = 1; i < agent_count; i++) {
+        int item = order[i], j = i;
+        for (; j > 0 && score[order[j - 1]] > score[item]; j--)
+            order[j] = order[j - 1];
+        order[j] = item;
+    }
+    for (int i = 0; i < n; i++) group[i] = order[i];
+    return n;
+}
+
+// Agents whose paths come closest to a cell chosen in proportion to how many agents cross it
+int pick_congestion(int *group, int n) {
+    static int visits[MAX_GRID][MAX_GRID];
+    static int seen[MAX_GRID][MAX_GRID];
+    memset(visits, 0, sizeof(visits));
+    memset(seen, -1, sizeof(seen));
+    int total = 0;
+    for (int a = 0; a < agent_count; a++) {
+        for (int t = 0; t < agents[a].path_len; t++) {
+            Pos p = agents[a].path[t];
+            if (seen[p.x][p.y] == a) continue;
+            seen[p.x][p.y] = a;
+            // Only cells shared by several agents count as congested
+            if (visits[p.x][p.y]++ > 0) total++;
+        }
+    }
+    Pos hot = agents[rand() % agent_count].start;
+    if (total > 0) {
+        int pick = rand() % total;
+        for (int i = 0; i < height && pick >= 0; i++)
+            for (int j = 0; j < width && pick >= 0; j++)
+                if (visits[i][j] > 1 && (pick -= visits[i][j] - 1) < 0)
+                    hot = (Pos){i, j};
+    }
+
+    int score[MAX_AGENTS];
+    for (int a = 0; a < agent_count; a++) {
+        score[a] = MAX_GRID * 2;
+        for (int t = 0; t < agents[a].path_len; t++) {
+            int d = abs(agents[a].path[t].x - hot.x) + abs(agents[a].path[t].y - hot.y);
+            if (d < score[a]) score[a] = d;
+        }
+    }
+    return pick_lowest(score, group, n);
+}
+
+// Agents drawn in proportion to how far they are behind their static shortest path
+int pick_delayed(const int *shortest, int *group, int n) {
+    int weight[MAX_AGENTS], total = 0;
+    for (int a = 0; a < agent_count; a++) {
+        weight[a] = (agents[a].path_len - 1 - shortest[a]) + 1;
+        total += weight[a];
+    }
+    for (int k = 0; k < n; k++) {
+        int pick = rand() % total, a = 0;
+        while (weight[a] == 0 || (pick -= weight[a]) >= 0) a++;
+        group[k] = a;
+        total -= weight[a];
+        weight[a] = 0;
+    }
+    return n;
+}
+
+// Removes the group's paths and replans them one by one, in random order, against everyone
+// else's. Keeps the new paths only if the sum of costs drops; returns the gain.
+int lns_repair(int *group, int n) {
+    Agent saved[MAX_AGENTS];
+    int before = sum_of_costs();
+    for (int k = 0; k < n; k++) {
+        saved[k] = agents[group[k]];
+        clear_occupancy(&agents[group[k]]);
+        agents[group[k]].path_len = 0;
+    }
+
+    int order[MAX_AGENTS];
+    for (int k = 0; k < n; k++) order[k] = group[k];
+    shuffle(order, n);
+    bool planned = true;
+    for (int k = 0; k < n && planned; k++) {
+        planned = bfs(&agents[order[k]]);
+        if (planned) set_occupancy(&agents[order[k]]);
+    }
+    if (planned && sum_of_costs() < before)
+        return before - sum_of_costs();
+
+    for (int k = 0; k < n; k++)
+        clear_occupancy(&agents[group[k]]);
+    for (int k = 0; k < n; k++) {
+        agents[group[k]] = saved[k];
+        set_occupancy(&agents[group[k]]);
+    }
+    return 0;
+}
+
+// Anytime MAPF-LNS: repeatedly replans a neighborhood of agents with prioritized planning and
+// keeps every improvement until the time budget runs out, LNS_STALL_LIMIT iterations in a row
+// bring nothing, or every agent is on its shortest path. Neighborhood kinds are chosen by
+// roulette wheel, weighted by the gains they produced recently.
+void lns_improve() {
+    if (LNS_TIME_BUDGET_MS <= 0 || agent_count < 2) return;
+    int n = (LNS_NEIGHBORHOOD < agent_count) ? LNS_NEIGHBORHOOD : agent_count;
+    int shortest[MAX_AGENTS], lower_bound = 0;
+    for (int a = 0; a < agent_count; a++) {
+        shortest[a] = static_distance(agents[a].start, agents[a].goal);
+        lower_bound += shortest[a];
+    }
+
+    double weights[NEIGHBORHOOD_COUNT] = {1.0, 1.0, 1.0};
+    int initial_cost = sum_of_costs(), initial_makespan = makespan();
+    int iterations = 0, improvements = 0, stalled = 0;
+    struct timespec start;
+    timespec_get(&start, TIME_UTC);
+    srand(LNS_SEED);
+
+    while (elapsed_ms(start) < LNS_TIME_BUDGET_MS && stalled < LNS_STALL_LIMIT &&
+           sum_of_costs() > lower_bound) {
+        double total = 0;
+        for (int k = 0; k < NEIGHBORHOOD_COUNT; k++) total += weights[k];
+        double pick = total * rand() / ((double)RAND_MAX + 1);
+        int kind = 0;
+        while (kind < NEIGHBORHOOD_COUNT - 1 && (pick -= weights[kind]) >= 0) kind++;
+
+        int group[MAX_AGENTS];
+        if (kind == NEIGHBORHOOD_CONGESTION) {
+            pick_congestion(group, n);
+        } else if (kind == NEIGHBORHOOD_DELAY) {
+            pick_delayed(shortest, group, n);
+        } else {
+            int all[MAX_AGENTS];
+            for (int a = 0; a < agent_count; a++) all[a] = a;
+            shuffle(all, agent_count);
+            memcpy(group, all, sizeof(int) * n);
+        }
+
+        int gain = lns_repair(group, n);
+        iterations++;
+        if (gain > 0) improvements++;
+        stalled = gain > 0 ? 0 : stalled + 1;
+        weights[kind] = LNS_REACTION * gain + (1 - LNS_REACTION) * weights[kind];
+        if (weights[kind] < 0.01) weights[kind] = 0.01;
+    }
+
+    printf("LNS: sum of costs %d -> %d, makespan %d -> %d (%d iterations, %d improvements in %.0f ms)\n",
+        initial_cost, sum_of_costs(), initial_makespan, makespan(), iterations, improvements, elapsed_ms(start));
+}
+
 void print_map(int t) {
     char visual[MAX_GRID][MAX_GRID];
     // Only copy the relevant portion of the map
@@ -237,11 +478,8 @@ int main() {
     for (int i = 0; i < height; i++)
         strcpy(map[i], raw[i]);
 
-    // Init occupancy: '.' for free, '#' for wall
-    for (int t = 0; t < MAX_TIME; t++)
-        for (int i = 0; i < height; i++)
-            for (int j = 0; j < width; j++)
-                occupancy[t][i][j] = (map[i][j] == '#') ? '#' : '.';
+    // Init occupancy: every cell free at every time (walls are left to is_valid)
+    rt_init(&occupancy, height * width, MAX_TIME);
 
     // Setup agents (initialize all fields)
     agent_count = 5;
@@ -265,7 +503,10 @@ int main() {
         }
         set_occupancy(&agents[i]);
     }
+    lns_improve();
 
     simulate();
+    rt_report(&occupancy, "Occupancy");
+    rt_free(&occupancy);
     return 0;
 }
\ No newline at end of file
@@ -1,6 +1,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
 #include <time.h>
 #ifdef _WIN32
 #include <windows.h>
@@ -10,6 +12,8 @@
 #define SLEEP(ms) usleep((ms)*1000)
 #endif
 
+#include "../common/reservation_table.h" // Link with common/reservation_table.c
+
 // Constants for grid and agent limits
 #define MAX_AGENTS 26
 #define MAX_GRID 50
@@ -35,7 +39,7 @@ typedef struct {
 } Instance;
 // Global instance and supporting arrays
 Instance inst;
-int reserved[MAX_GRID][MAX_GRID][MAX_PATH]; // Space-time reservation grid
+ReservationTable reserved;                 // Space-time reservations, cell = row * width + col
 int done_agents[MAX_AGENTS];               // Track if agent is done
 int finished_time[MAX_AGENTS];             // When each agent finished
 char agent_names[MAX_AGENTS];              // Agent labels (e.g., A, B, C)
@@ -48,11 +52,11 @@ int is_valid(int x, int y) {
 }
 // Reset reservation grid based on current paths
 void reset_reserved() {
-    memset(reserved, 0, sizeof(reserved));
+    rt_clear(&reserved);
     for (int a = 0; a < inst.num_agents; a++) {
         for (int t = 0; t < inst.paths[a].length; t++) {
             Point p = inst.paths[a].path[t];
-            reserved[p.x][p.y][t] = 1;
+            rt_set(&reserved, p.x * inst.width + p.y, t, 1);
         }
     }
 }
@@ -90,7 +94,7 @@ int bfs(int agent, Point start, Point goal, int start_time, int forbid_x, int fo
             int nt = cur.time + 1;
             if (nt >= MAX_PATH) continue; // Prevent out-of-bounds
             if (!is_valid(nx, ny) || (nx == forbid_x && ny == forbid_y)) continue;
-            if (reserved[nx][ny][nt]) continue;
+            if (rt_get(&reserved, nx * inst.width + ny, nt)) continue;
             // Prevent edge swap conflict
             if (d != 4 && cur.time > 0) {
                 for (int a = 0; a < inst.num_agents; a++) {
@@ -122,7 +126,7 @@ int bfs(int agent, Point start, Point goal, int start_time, int forbid_x, int fo
 void reserve_path(int agent) {
     for (int t = 0; t < inst.paths[agent].length; t++) {
         Point p = inst.paths[agent].path[t];
-        reserved[p.x][p.y][t] = 1;
+        rt_set(&reserved, p.x * inst.width + p.y, t, 1);
     }
 }
 
@@ -131,7 +135,7 @@ void pad_and_reserve_agent(int agent, int target_len) {
     Point last = inst.paths[agent].path[inst.paths[agent].length - 1];
     for (int t = inst.paths[agent].length; t < target_len; t++) {
         inst.paths[agent].path[t] = last;
-        reserved[last.x][last.y][t] = 1;
+        rt_set(&reserved, last.x * inst.width + last.y, t, 1);
     }
     inst.paths[agent].length = target_len;
 }
@@ -428,7 +432,10 @@ void load_instance() {
 int main() {
     srand(time(NULL));
     load_instance();
+    rt_init(&reserved, inst.height * inst.width, MAX_PATH);
     run_stms();
     visualize();
+    rt_report(&reserved, "Reservations");
+    rt_free(&reserved);
     return 0;
 }
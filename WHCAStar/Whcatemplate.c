@@ -3,14 +3,25 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <pthread.h>
 #include <unistd.h> // For sleep()
 
 #define GRID_WIDTH 7
 #define GRID_HEIGHT 7
 #define MAX_AGENTS 10
-#define MAX_PATH 100
-#define WINDOW 1000
+#define MAX_PATH 100 // Time steps kept for the replay
+#define MAX_STEPS 1000 // Time steps simulated before giving up; memory does not grow with it
+#define WINDOW 8 // Time steps each agent plans and reserves ahead
+#define REPLAN_INTERVAL (WINDOW / 2) // Time steps executed before everyone replans
 #define STEP_DELAY 1000000 // Microseconds (0.5 sec)
+#define RESTART_ORDERS 32 // Priority orders tried; the best complete run is replayed
+#define RESTART_THREADS 4 // Threads trying orders (build with -pthread)
+#define RESTART_DEADLINE_MS 2000 // No new order is started after this
+#define RESTART_SEED 1 // Seed of the random orders
 
 typedef struct {
     int x, y;
@@ -23,9 +34,13 @@ typedef struct {
 
 typedef struct {
     Position start, goal;
-    Path path;
+    Path path; // Positions actually visited, path.pos[t] at time t for the first MAX_PATH steps
     char name; // Agent name (A, B, C, ...)
     bool finished;
+    Path plan; // Plan for the current window, plan.pos[0] at the window start
+    bool searched; // The plan came from a search, so the next window may keep its remainder
+    Position at; // Where the agent is now
+    int arrived; // Time it last reached its goal and stayed, -1 while away
 } Agent;
 
 typedef struct Node {
@@ -49,7 +64,62 @@ char map[GRID_HEIGHT][GRID_WIDTH] = {
 
 
 bool grid[GRID_HEIGHT][GRID_WIDTH]; // true = free, false = obstacle
-bool reservation_table[GRID_HEIGHT][GRID_WIDTH][MAX_PATH]; // reserved by time
+
+// Reservations of the live window as time-major bit rows: one row of cell bits per window
+// step, cleared at every window start. Cell c is bit c + GRID_WIDTH, so the cells one move
+// away, c - GRID_WIDTH through c + GRID_WIDTH, are the low bits of a single 64-bit read at
+// bit c on grids up to 31 wide; wider grids read the rows above, beside and below apart.
+// Edge rows have 4 bits per cell; bit cell * 4 + dir is set when leaving the cell in `dir` at
+// that step would swap with an agent coming the other way. Bits carry no owner: an agent's
+// own reservations are dropped before it searches, so any set bit is someone else's.
+#define NEIGHBOURS_IN_WORD (2 * GRID_WIDTH + 1 <= 64) // Otherwise the three rows are read apart
+#define CELL_ROW_WORDS ((GRID_WIDTH * GRID_HEIGHT + 2 * GRID_WIDTH + 63) / 64 + 1) // +1 so any read stays inside
+#define EDGE_ROW_WORDS ((GRID_WIDTH * GRID_HEIGHT * 4 + 63) / 64)
+
+typedef struct {
+    uint64_t cells[WINDOW + 1][CELL_ROW_WORDS];
+    uint64_t edges[WINDOW + 1][EDGE_ROW_WORDS];
+} ReservationRows;
+
+void row_set(uint64_t row[], int bit) {
+    row[bit >> 6] |= (uint64_t)1 << (bit & 63);
+}
+
+// The 64 bits of a row starting at `bit`
+uint64_t row_window(const uint64_t row[], int bit) {
+    int word = bit >> 6, shift = bit & 63;
+    return shift ? row[word] >> shift | row[word + 1] << (64 - shift) : row[word];
+}
+
+// Planner state is per thread, so every restart worker runs on its own reservations
+_Thread_local ReservationRows reservations;
+int open_moves[GRID_WIDTH * GRID_HEIGHT]; // Bit dir set if the move stays on the grid and off walls
+
+// An agent resting on its goal from time `from` through the end of the horizon, kept as one
+// interval per cell instead of an entry for every step. Holds outlive the window they were
+// planned in, so agents parked on their goals need no search until someone needs the cell.
+typedef struct {
+    int owner; // Agent index + 1, 0 if the cell is open
+    int from;
+} GoalHold;
+
+_Thread_local GoalHold goal_hold[GRID_HEIGHT][GRID_WIDTH];
+_Thread_local int window_start; // Time of window step 0
+_Thread_local int stuck_windows[MAX_AGENTS]; // Windows each agent spent boxed in
+
+// Reverse Resumable A*: a backward search from each agent's goal towards its start over the
+// static grid, resumed only as far as needed to get the true distance of a queried cell
+typedef struct {
+    Position goal, target;
+    int g[GRID_HEIGHT][GRID_WIDTH]; // Best known distance from the goal
+    bool closed[GRID_HEIGHT][GRID_WIDTH]; // g is exact
+    bool in_open[GRID_HEIGHT][GRID_WIDTH];
+    Position open[GRID_WIDTH * GRID_HEIGHT];
+    int open_size;
+    int expanded;
+} ReverseSearch;
+
+_Thread_local ReverseSearch reverse_search[MAX_AGENTS];
 
 int manhattan(Position a, Position b) {
     return abs(a.x - b.x) + abs(a.y - b.y);
@@ -59,28 +129,182 @@ bool is_valid(int x, int y) {
     return x >= 0 && y >= 0 && x < GRID_WIDTH && y < GRID_HEIGHT && grid[y][x];
 }
 
-bool is_reserved(int x, int y, int time) {
-    if (time >= MAX_PATH) return true;
-    return reservation_table[y][x][time];
+// Moves out of (x, y) arriving at window step `time` that another agent has taken, one bit
+// per direction: the five target cells come from one read of the cell row (three on grids too
+// wide for that), the swaps from one nibble of the edge row
+int blocked_moves(int x, int y, int time) {
+    int cell = y * GRID_WIDTH + x;
+    const uint64_t *row = reservations.cells[time];
+#if NEIGHBOURS_IN_WORD
+    uint64_t near = row_window(row, cell);
+    int below = (int)(near >> (2 * GRID_WIDTH) & 1), above = (int)(near & 1);
+    uint64_t side = near >> (GRID_WIDTH - 1); // x - 1, x, x + 1 in the low bits
+#else
+    int below = (int)(row_window(row, cell + 2 * GRID_WIDTH) & 1), above = (int)(row_window(row, cell) & 1);
+    uint64_t side = row_window(row, cell + GRID_WIDTH - 1);
+#endif
+    int taken = below | // dir 0: y + 1
+        (int)(side >> 2 & 1) << 1 | // dir 1: x + 1
+        above << 2 | // dir 2: y - 1
+        (int)(side & 1) << 3 | // dir 3: x - 1
+        (int)(side >> 1 & 1) << 4; // dir 4: wait
+    int swaps = (int)(reservations.edges[time][cell >> 4] >> ((cell & 15) * 4) & 15);
+    return taken | swaps;
+}
+
+// Direction index of the move from a to b, 4 if it is a wait
+int move_dir(Position a, Position b) {
+    for (int dir = 0; dir < 4; dir++) {
+        if (a.x + dx[dir] == b.x && a.y + dy[dir] == b.y) return dir;
+    }
+    return 4;
+}
+
+void clear_reservations(void) {
+    memset(&reservations, 0, sizeof(reservations));
+}
+
+// Block the goal cell from `from` (absolute time) through the end of the window
+void reserve_hold(Position goal, int from) {
+    int t = from > window_start ? from - window_start : 0;
+    for (; t <= WINDOW; t++) row_set(reservations.cells[t], goal.y * GRID_WIDTH + goal.x + GRID_WIDTH);
+}
+
+// Re-open the goal an agent rests on so others may pass; it has to move aside when it replans
+void release_goal(int self, Position goal) {
+    if (goal_hold[goal.y][goal.x].owner == self + 1) goal_hold[goal.y][goal.x].owner = 0;
+}
+
+// Reserve a whole plan at once, one bit per step in the cell and edge rows
+void reserve_path(Path *path, int self, Position goal) {
+    // Steps spent resting on the goal at the end of the plan become a single hold
+    int arrival = path->length;
+    while (arrival > 0 && path->pos[arrival - 1].x == goal.x && path->pos[arrival - 1].y == goal.y) arrival--;
+    if (arrival < path->length) {
+        goal_hold[goal.y][goal.x] = (GoalHold){self + 1, window_start + arrival};
+        reserve_hold(goal, window_start + arrival);
+    }
+
+    for (int t = 0; t < path->length && t <= WINDOW; t++) {
+        int cell = path->pos[t].y * GRID_WIDTH + path->pos[t].x;
+        if (t < arrival) row_set(reservations.cells[t], cell + GRID_WIDTH);
+
+        // Reserve the edge taken so nobody crosses it the other way; following into the
+        // cell just left stays allowed
+        if (t > 0) {
+            int dir = move_dir(path->pos[t - 1], path->pos[t]);
+            if (dir < 4) row_set(reservations.edges[t], cell * 4 + (dir + 2) % 4);
+        }
+    }
 }
 
-void reserve_path(Path *path) {
-    for (int t = 0; t < path->length && t < MAX_PATH; t++) {
-        int x = path->pos[t].x;
-        int y = path->pos[t].y;
-        reservation_table[y][x][t] = true;
+void init_reverse_search(int self, Position goal, Position target) {
+    ReverseSearch *rs = &reverse_search[self];
+    rs->goal = goal;
+    rs->target = target;
+    rs->open_size = 0;
+    rs->expanded = 0;
+    for (int y = 0; y < GRID_HEIGHT; y++) {
+        for (int x = 0; x < GRID_WIDTH; x++) {
+            rs->g[y][x] = INT_MAX;
+            rs->closed[y][x] = false;
+            rs->in_open[y][x] = false;
+        }
+    }
+    rs->g[goal.y][goal.x] = 0;
+    rs->in_open[goal.y][goal.x] = true;
+    rs->open[rs->open_size++] = goal;
+}
 
-        // Prevent swap collisions: reserve the previous position at the next time step
-        if (t > 0 && (t < MAX_PATH)) {
-            int prev_x = path->pos[t - 1].x;
-            int prev_y = path->pos[t - 1].y;
-            reservation_table[prev_y][prev_x][t] = true;
+// Resume the backward search until (x, y) is expanded; unreachable cells cost GRID_WIDTH * GRID_HEIGHT
+int abstract_distance(int self, int x, int y) {
+    ReverseSearch *rs = &reverse_search[self];
+    while (!rs->closed[y][x]) {
+        if (rs->open_size == 0) return GRID_WIDTH * GRID_HEIGHT;
+
+        // Find lowest f towards the agent's start
+        int best = 0, best_f = INT_MAX;
+        for (int i = 0; i < rs->open_size; i++) {
+            Position p = rs->open[i];
+            int f = rs->g[p.y][p.x] + manhattan(p, rs->target);
+            if (f < best_f) {
+                best = i;
+                best_f = f;
+            }
+        }
+        Position current = rs->open[best];
+        rs->open[best] = rs->open[--rs->open_size];
+        rs->in_open[current.y][current.x] = false;
+        rs->closed[current.y][current.x] = true;
+        rs->expanded++;
+
+        for (int dir = 0; dir < 4; dir++) {
+            int nx = current.x + dx[dir], ny = current.y + dy[dir];
+            if (!is_valid(nx, ny) || rs->closed[ny][nx]) continue;
+            if (rs->g[current.y][current.x] + 1 >= rs->g[ny][nx]) continue;
+            rs->g[ny][nx] = rs->g[current.y][current.x] + 1;
+            if (!rs->in_open[ny][nx]) {
+                rs->in_open[ny][nx] = true;
+                rs->open[rs->open_size++] = (Position){nx, ny};
+            }
         }
     }
+    return rs->g[y][x];
+}
+
+// Search buffers shared by every whca_star call of a thread, allocated once. A state belongs to
+// the current search only while its stamp equals search_generation, so starting a search is O(1).
+#define SEARCH_STATES (GRID_WIDTH * GRID_HEIGHT * (WINDOW + 1))
+#define NODE_CAPACITY (5 * SEARCH_STATES + WINDOW + 1) // Each closed state pushes at most 5 successors, plus a kept prefix
+
+_Thread_local Node *node_pool; // Nodes of the current search, parents point back into the pool
+_Thread_local int node_count;
+_Thread_local Node **open_heap; // Binary min-heap on f
+_Thread_local int open_size;
+_Thread_local uint32_t *closed_stamp; // Expanded in the current search
+_Thread_local uint32_t *seen_stamp; // best_g is valid in the current search
+_Thread_local int *best_g;
+_Thread_local uint32_t search_generation;
+_Thread_local int warm_searches, full_searches; // Window searches seeded with a kept prefix / from scratch
+_Thread_local long window_expanded; // States expanded by all window searches
+
+void init_search_buffers(void) {
+    node_pool = malloc(NODE_CAPACITY * sizeof(Node));
+    open_heap = malloc(NODE_CAPACITY * sizeof(Node*));
+    closed_stamp = calloc(SEARCH_STATES, sizeof(uint32_t));
+    seen_stamp = calloc(SEARCH_STATES, sizeof(uint32_t));
+    best_g = malloc(SEARCH_STATES * sizeof(int));
+    if (!node_pool || !open_heap || !closed_stamp || !seen_stamp || !best_g) {
+        fprintf(stderr, "Out of memory for search buffers.\n");
+        exit(1);
+    }
+}
+
+void free_search_buffers(void) {
+    free(node_pool);
+    free(open_heap);
+    free(closed_stamp);
+    free(seen_stamp);
+    free(best_g);
+}
+
+void begin_search(void) {
+    node_count = 0;
+    open_size = 0;
+    if (++search_generation == 0) {
+        // Stamps wrapped around: clear them once so old ones cannot match
+        memset(closed_stamp, 0, SEARCH_STATES * sizeof(uint32_t));
+        memset(seen_stamp, 0, SEARCH_STATES * sizeof(uint32_t));
+        search_generation = 1;
+    }
+}
+
+int state_index(int x, int y, int time) {
+    return (time * GRID_HEIGHT + y) * GRID_WIDTH + x;
 }
 
 Node* create_node(int x, int y, int g, int h, int time, Node* parent) {
-    Node* n = malloc(sizeof(Node));
+    Node* n = &node_pool[node_count++];
     n->pos = (Position){x, y};
     n->g = g;
     n->h = h;
@@ -90,81 +314,119 @@ Node* create_node(int x, int y, int g, int h, int time, Node* parent) {
     return n;
 }
 
-void free_all_nodes(Node* list[], int count) {
-    for (int i = 0; i < count; i++) {
-        free(list[i]);
-    }
+// Lower f first, ties go to the node further along in time
+bool node_before(Node* a, Node* b) {
+    return a->f < b->f || (a->f == b->f && a->time > b->time);
 }
 
-// WHCA* A* planner for a single agent with reservations
-bool whca_star(Agent* agent, int window) {
-    Node* open[MAX_PATH * GRID_WIDTH * GRID_HEIGHT];
-    bool closed[GRID_HEIGHT][GRID_WIDTH][WINDOW] = {false};
-    int open_size = 0;
-
-    Position start = agent->start;
-    Position goal = agent->goal;
+void open_push(Node* n) {
+    int i = open_size++;
+    while (i > 0 && node_before(n, open_heap[(i - 1) / 2])) {
+        open_heap[i] = open_heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    open_heap[i] = n;
+}
 
-    Node* start_node = create_node(start.x, start.y, 0,
-        manhattan(start, goal), 0, NULL);
-    open[open_size++] = start_node;
-    Node* goal_node = NULL;
+Node* open_pop(void) {
+    Node* top = open_heap[0];
+    Node* last = open_heap[--open_size];
+    int i = 0;
+    while (2 * i + 1 < open_size) {
+        int child = 2 * i + 1;
+        if (child + 1 < open_size && node_before(open_heap[child + 1], open_heap[child])) child++;
+        if (!node_before(open_heap[child], last)) break;
+        open_heap[i] = open_heap[child];
+        i = child;
+    }
+    open_heap[i] = last;
+    return top;
+}
 
+// A* over (cell, time) from `seed` to the end of the window, avoiding cells other agents
+// reserved. Returns the node reached at step `window`, or NULL if every way is blocked or
+// would end above f_limit.
+Node* search_window(Node* seed, int self, Position goal, int window, int f_limit) {
+    open_push(seed);
     while (open_size > 0) {
-        // Find lowest f
-        int best = 0;
-        for (int i = 1; i < open_size; i++) {
-            if (open[i]->f < open[best]->f) best = i;
-        }
-        Node* current = open[best];
-        open[best] = open[--open_size];
+        Node* current = open_pop();
+        if (current->f > f_limit) return NULL;
 
-        // Check goal
-        if (current->pos.x == goal.x && current->pos.y == goal.y) {
-            goal_node = current;
-            break;
-        }
-
-        // Time window limit
-        if (current->time >= window) {
-            free(current);
-            continue;
-        }
+        // End of the window: the best plan found
+        if (current->time == window) return current;
 
         // Skip if already closed
-        if (closed[current->pos.y][current->pos.x][current->time]) {
-            free(current);
-            continue;
-        }
-        closed[current->pos.y][current->pos.x][current->time] = true;
+        int state = state_index(current->pos.x, current->pos.y, current->time);
+        if (closed_stamp[state] == search_generation) continue;
+        closed_stamp[state] = search_generation;
+        window_expanded++;
 
         // Expand neighbors including wait
+        int nt = current->time + 1;
+        if (nt > WINDOW) continue;
+        int moves = open_moves[current->pos.y * GRID_WIDTH + current->pos.x] &
+            ~blocked_moves(current->pos.x, current->pos.y, nt);
         for (int dir = 0; dir < 5; dir++) {
+            if (!(moves >> dir & 1)) continue;
             int nx = current->pos.x + dx[dir];
             int ny = current->pos.y + dy[dir];
-            int nt = current->time + 1;
-
-            if (dir < 4 && !is_valid(nx, ny)) continue;
-            if (is_reserved(nx, ny, nt)) continue;
-            if (nt < WINDOW && closed[ny][nx][nt]) continue;
-
-            if (open_size < MAX_PATH * GRID_WIDTH * GRID_HEIGHT) {
-                Node* neighbor = create_node(nx, ny,
-                    current->g + 1,
-                    manhattan((Position){nx, ny}, goal),
-                    nt, current);
-                open[open_size++] = neighbor;
-            }
+            int next = state_index(nx, ny, nt);
+            if (closed_stamp[next] == search_generation) continue;
+
+            bool resting = dir == 4 && nx == goal.x && ny == goal.y;
+            int g = current->g + (resting ? 0 : 1);
+            // Only queue the state again if this reaches it cheaper
+            if (seen_stamp[next] == search_generation && best_g[next] <= g) continue;
+            seen_stamp[next] = search_generation;
+            best_g[next] = g;
+
+            open_push(create_node(nx, ny, g, abstract_distance(self, nx, ny), nt, current));
         }
     }
+    return NULL;
+}
 
+// WHCA* A* planner for a single agent with reservations. Plans `window` steps from `from`,
+// avoiding cells other agents reserved. The heuristic is the true distance to the goal from the
+// agent's reverse search, so the last step is scored with its cost-to-go; waiting on the goal is
+// free, so the plan gets as close as it can within the window.
+// `prefix` is what is left of the agent's previous plan, prefix[0] == from. While none of its
+// steps has been taken by agents planning earlier it is kept and only the steps after it are
+// searched. Every step costs 1 and changes the heuristic by at most 1, so no plan ends below
+// f = h(from); a kept plan reaching that bound is as good as a fresh one. Otherwise (a step
+// was taken, or the agent now waits behind someone) the whole window is searched again.
+bool whca_star(Agent* agent, int self, Position from, int window, const Position prefix[], int prefix_length) {
+    Position goal = agent->goal;
+    Node* goal_node = NULL;
+
+    bool keep = prefix_length > 1;
+    for (int t = 1; keep && t < prefix_length; t++) {
+        Position p = prefix[t], q = prefix[t - 1];
+        keep = !(blocked_moves(q.x, q.y, t) >> move_dir(q, p) & 1);
+    }
+    if (keep) {
+        begin_search();
+        Node* seed = NULL;
+        for (int t = 0; t < prefix_length; t++) {
+            bool resting = t > 0 && prefix[t].x == goal.x && prefix[t].y == goal.y &&
+                prefix[t - 1].x == goal.x && prefix[t - 1].y == goal.y;
+            int g = seed ? seed->g + (resting ? 0 : 1) : 0;
+            seed = create_node(prefix[t].x, prefix[t].y, g, abstract_distance(self, prefix[t].x, prefix[t].y), t, seed);
+        }
+        goal_node = search_window(seed, self, goal, window, abstract_distance(self, from.x, from.y));
+        if (goal_node) warm_searches++;
+    }
     if (!goal_node) {
-        free_all_nodes(open, open_size);
-        return false;
+        begin_search();
+        Node* start_node = create_node(from.x, from.y, 0, abstract_distance(self, from.x, from.y), 0, NULL);
+        goal_node = search_window(start_node, self, goal, window, INT_MAX);
+        full_searches++;
     }
 
+    if (!goal_node) return false;
+
     // Reconstruct path
-    Path* path = &agent->path;
+    Path* path = &agent->plan;
     path->length = 0;
     Node* n = goal_node;
     while (n && path->length < MAX_PATH) {
@@ -179,13 +441,107 @@ bool whca_star(Agent* agent, int window) {
         path->pos[path->length - i - 1] = tmp;
     }
 
-    reserve_path(path);
-
-    // Free remaining nodes
-    free_all_nodes(open, open_size);
+    reserve_path(path, self, goal);
     return true;
 }
 
+bool is_parked(Agent *agent, int self, int now) {
+    Position p = agent->at;
+    GoalHold *hold = &goal_hold[agent->goal.y][agent->goal.x];
+    return p.x == agent->goal.x && p.y == agent->goal.y &&
+        hold->owner == self + 1 && hold->from <= now;
+}
+
+// Start of a window: drop the old reservations and let every agent plan its next WINDOW steps
+// from where it stands, in a priority order that rotates each window so no agent always yields.
+// Agents parked on their goals keep their holds and stay put. An agent that cannot find a
+// plan makes the parked agents within its reach yield; otherwise it moves to the front and the
+// window is planned again. An agent boxed in whatever the order holds its cell for the window,
+// reserved before anyone plans so that no path goes through it.
+// Each parked agent yields, and each agent moves to the front or is boxed in, at most once per
+// window. Every retry uses up one of these, so planning ends with a full pass in which every
+// agent got a plan for this window.
+// Plans overlap by WINDOW - REPLAN_INTERVAL steps, so the part of each agent's last plan not yet
+// executed is offered to whca_star as a warm start.
+void plan_window(Agent agents[], int agent_count, const int priority[], int now, int round) {
+    int order[MAX_AGENTS];
+    for (int k = 0; k < agent_count; k++) order[k] = priority[(round + k) % agent_count];
+    window_start = now;
+
+    Position carry[MAX_AGENTS][WINDOW + 1];
+    int carry_length[MAX_AGENTS];
+    bool boxed[MAX_AGENTS] = {false}, promoted[MAX_AGENTS] = {false}, made_way[MAX_AGENTS] = {false};
+    for (int i = 0; i < agent_count; i++) {
+        Path *plan = &agents[i].plan;
+        carry_length[i] = 0;
+        if (!agents[i].searched || plan->length != WINDOW + 1) continue;
+        carry_length[i] = WINDOW - REPLAN_INTERVAL + 1;
+        memcpy(carry[i], &plan->pos[REPLAN_INTERVAL], carry_length[i] * sizeof(Position));
+    }
+
+    for (;;) {
+        clear_reservations();
+        bool parked[MAX_AGENTS];
+        // Holds of agents that left their goal, never got there or made way are stale; the
+        // others block their goals for this window
+        for (int i = 0; i < agent_count; i++) {
+            Position goal = agents[i].goal;
+            parked[i] = !made_way[i] && is_parked(&agents[i], i, now);
+            if (!parked[i]) release_goal(i, goal);
+            else reserve_hold(goal, goal_hold[goal.y][goal.x].from);
+        }
+        // Boxed-in agents stay where they are
+        for (int i = 0; i < agent_count; i++) {
+            if (!boxed[i]) continue;
+            agents[i].plan.length = WINDOW + 1;
+            for (int t = 0; t <= WINDOW; t++) agents[i].plan.pos[t] = agents[i].at;
+            reserve_path(&agents[i].plan, i, agents[i].goal);
+        }
+
+        int failed = -1;
+        for (int k = 0; k < agent_count; k++) {
+            int i = order[k];
+            Position from = agents[i].at;
+            if (boxed[i]) continue;
+            agents[i].searched = false;
+            if (parked[i]) {
+                agents[i].plan.length = 1;
+                agents[i].plan.pos[0] = from;
+                continue;
+            }
+            if (whca_star(&agents[i], i, from, WINDOW, carry[i], carry_length[i])) {
+                agents[i].searched = true;
+                continue;
+            }
+
+            // Ask the parked agents it could reach this window to make way
+            bool yielded = false;
+            for (int j = 0; j < agent_count; j++) {
+                if (j != i && parked[j] && manhattan(agents[j].goal, from) <= WINDOW) {
+                    release_goal(j, agents[j].goal);
+                    made_way[j] = yielded = true;
+                }
+            }
+            failed = k;
+            if (yielded) break;
+            if (k > 0 && !promoted[i]) {
+                promoted[i] = true;
+                break;
+            }
+            // Boxed in whatever the order: hold position for the window, reserved ahead of
+            // everyone else's plans
+            boxed[i] = true;
+            stuck_windows[i]++;
+            break;
+        }
+        if (failed < 0) return;
+
+        int i = order[failed];
+        memmove(&order[1], &order[0], failed * sizeof(int));
+        order[0] = i;
+    }
+}
+
 void print_grid(Agent agents[], int agent_count, int time) {
     char display[GRID_HEIGHT][GRID_WIDTH];
     memcpy(display, map, sizeof(map));
@@ -222,7 +578,9 @@ void print_grid(Agent agents[], int agent_count, int time) {
             // Occupying goal of a finished agent
             for (int b = 0; b < agent_count; b++) {
                 if (b != a && agents[b].finished &&
-                    x == agents[b].goal.x && y == agents[b].goal.y) {
+                    x == agents[b].goal.x && y == agents[b].goal.y &&
+                    time < agents[b].path.length &&
+                    agents[b].path.pos[time].x == x && agents[b].path.pos[time].y == y) {
                     printf("WARNING: Agent %c occupies the goal of finished Agent %c at (%d,%d) at time %d!\n",
                         agent_char, agents[b].name, x, y, time);
                     printf("  Agent %c previous: (%d,%d)\n", agent_char,
@@ -256,34 +614,241 @@ void setup_grid() {
             grid[y][x] = (map[y][x] != '#');
         }
     }
+    for (int y = 0; y < GRID_HEIGHT; y++) {
+        for (int x = 0; x < GRID_WIDTH; x++) {
+            int moves = 1 << 4; // Waiting is always possible
+            for (int dir = 0; dir < 4; dir++) {
+                if (is_valid(x + dx[dir], y + dy[dir])) moves |= 1 << dir;
+            }
+            open_moves[y * GRID_WIDTH + x] = moves;
+        }
+    }
+}
+
+// Run the rolling-window simulation with the given base priority order, recording what every
+// agent does in agents[i].path. Returns the time the last agent got home (or MAX_STEPS).
+int simulate(Agent agents[], int agent_count, const int priority[]) {
+    window_start = 0;
+    clear_reservations();
+    memset(goal_hold, 0, sizeof(goal_hold));
+    memset(stuck_windows, 0, sizeof(stuck_windows));
+    for (int i = 0; i < agent_count; i++) {
+        agents[i].at = agents[i].path.pos[0] = agents[i].start;
+        agents[i].path.length = 1;
+        agents[i].finished = false;
+        agents[i].searched = false;
+        agents[i].arrived = agents[i].start.x == agents[i].goal.x && agents[i].start.y == agents[i].goal.y ? 0 : -1;
+    }
+
+    // Rolling windows: replan every REPLAN_INTERVAL steps and execute the plans in between.
+    // Reservations only cover the WINDOW + 1 steps of the live window, so the run can go on
+    // for as long as it takes without using more memory.
+    int now = 0, round = 0;
+    while (now < MAX_STEPS) {
+        bool all_home = true;
+        for (int i = 0; i < agent_count; i++) {
+            if (agents[i].arrived < 0) all_home = false;
+        }
+        if (all_home) break;
+
+        if (now % REPLAN_INTERVAL == 0) plan_window(agents, agent_count, priority, now, round++);
+        int step = now % REPLAN_INTERVAL + 1;
+        for (int i = 0; i < agent_count; i++) {
+            Agent *a = &agents[i];
+            a->at = a->plan.pos[step < a->plan.length ? step : a->plan.length - 1];
+            bool home = a->at.x == a->goal.x && a->at.y == a->goal.y;
+            if (!home) a->arrived = -1;
+            else if (a->arrived < 0) a->arrived = now + 1;
+            if (now + 1 < MAX_PATH) {
+                a->path.pos[now + 1] = a->at;
+                a->path.length = now + 2;
+            }
+        }
+        now++;
+    }
+    return now;
+}
+
+typedef struct {
+    Agent agents[MAX_AGENTS]; // Trajectories of the run
+    int order_id, home, makespan, cost;
+    int stuck[MAX_AGENTS];
+    int expanded; // Cells expanded by the reverse searches of all workers
+    int warm_searches, full_searches; // Window searches of all runs of all workers
+    long window_expanded;
+    int orders_tried;
+} RestartResult;
+
+Agent *restart_agents; // Scenario shared read-only by the workers
+int restart_agent_count;
+atomic_int next_order;
+struct timespec restart_deadline;
+
+// Order 0 is the plain rotation, 1 puts the longest trips first, 2 the most constrained agents
+// (fewest free cells around start and goal) first, and the rest are seeded shuffles
+void make_order(int id, int agent_count, int order[]) {
+    for (int k = 0; k < agent_count; k++) order[k] = k;
+    if (id == 0) return;
+
+    int key[MAX_AGENTS];
+    if (id <= 2) {
+        for (int i = 0; i < agent_count; i++) {
+            Position s = restart_agents[i].start, g = restart_agents[i].goal;
+            if (id == 1) {
+                key[i] = -abstract_distance(i, s.x, s.y);
+            } else {
+                key[i] = 0;
+                for (int dir = 0; dir < 4; dir++) {
+                    key[i] += is_valid(s.x + dx[dir], s.y + dy[dir]) + is_valid(g.x + dx[dir], g.y + dy[dir]);
+                }
+            }
+        }
+        // Stable insertion sort on the key
+        for (int k = 1; k < agent_count; k++) {
+            int a = order[k], j = k;
+            while (j > 0 && key[order[j - 1]] > key[a]) {
+                order[j] = order[j - 1];
+                j--;
+            }
+            order[j] = a;
+        }
+        return;
+    }
+
+    unsigned seed = RESTART_SEED + id;
+    for (int k = agent_count - 1; k > 0; k--) {
+        int j = rand_r(&seed) % (k + 1);
+        int tmp = order[k];
+        order[k] = order[j];
+        order[j] = tmp;
+    }
+}
+
+// More agents home first, then the earlier finish, the lower sum of costs and the lower order id
+bool better_result(RestartResult *a, RestartResult *b) {
+    if (a->home != b->home) return a->home > b->home;
+    if (a->makespan != b->makespan) return a->makespan < b->makespan;
+    if (a->cost != b->cost) return a->cost < b->cost;
+    return a->order_id < b->order_id;
+}
+
+bool past_deadline(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec > restart_deadline.tv_sec ||
+        (now.tv_sec == restart_deadline.tv_sec && now.tv_nsec >= restart_deadline.tv_nsec);
+}
+
+// Worker: claims orders until they run out or the deadline passes, keeping its best run
+void* restart_worker(void* arg) {
+    RestartResult *best = arg;
+    RestartResult *run = malloc(sizeof(RestartResult));
+    int agent_count = restart_agent_count;
+    init_search_buffers();
+    for (int i = 0; i < agent_count; i++) {
+        init_reverse_search(i, restart_agents[i].goal, restart_agents[i].start);
+    }
+
+    best->order_id = -1;
+    best->orders_tried = 0;
+    warm_searches = full_searches = 0;
+    window_expanded = 0;
+    int id;
+    while ((id = atomic_fetch_add(&next_order, 1)) < RESTART_ORDERS) {
+        if (id > 0 && past_deadline()) break;
+
+        int order[MAX_AGENTS];
+        make_order(id, agent_count, order);
+        memcpy(run->agents, restart_agents, agent_count * sizeof(Agent));
+        run->order_id = id;
+        run->makespan = simulate(run->agents, agent_count, order);
+        run->home = run->cost = 0;
+        for (int i = 0; i < agent_count; i++) {
+            // Cost: time of the last arrival on the goal, or the whole run if still away
+            int arrived = run->agents[i].arrived;
+            if (arrived >= 0) run->home++;
+            run->cost += arrived >= 0 ? arrived : run->makespan;
+            run->stuck[i] = stuck_windows[i];
+        }
+        best->orders_tried++;
+        if (best->order_id < 0 || better_result(run, best)) {
+            int tried = best->orders_tried;
+            *best = *run;
+            best->orders_tried = tried;
+        }
+    }
+
+    best->expanded = 0;
+    for (int i = 0; i < agent_count; i++) best->expanded += reverse_search[i].expanded;
+    best->warm_searches = warm_searches;
+    best->full_searches = full_searches;
+    best->window_expanded = window_expanded;
+    free(run);
+    free_search_buffers();
+    return NULL;
+}
+
+// Try RESTART_ORDERS priority orders on RESTART_THREADS threads, each on its own planner
+// state, and return the best run. Order 0 always runs, so there is a result at any deadline.
+RestartResult run_restarts(Agent agents[], int agent_count) {
+    restart_agents = agents;
+    restart_agent_count = agent_count;
+    atomic_store(&next_order, 0);
+    clock_gettime(CLOCK_MONOTONIC, &restart_deadline);
+    restart_deadline.tv_sec += RESTART_DEADLINE_MS / 1000;
+    restart_deadline.tv_nsec += (RESTART_DEADLINE_MS % 1000) * 1000000L;
+    if (restart_deadline.tv_nsec >= 1000000000L) {
+        restart_deadline.tv_sec++;
+        restart_deadline.tv_nsec -= 1000000000L;
+    }
+
+    static RestartResult results[RESTART_THREADS];
+    pthread_t threads[RESTART_THREADS];
+    for (int t = 1; t < RESTART_THREADS; t++) {
+        pthread_create(&threads[t], NULL, restart_worker, &results[t]);
+    }
+    restart_worker(&results[0]);
+    for (int t = 1; t < RESTART_THREADS; t++) {
+        pthread_join(threads[t], NULL);
+    }
+
+    int best = -1, tried = 0, expanded = 0, warm = 0, full = 0;
+    long window_expanded = 0;
+    for (int t = 0; t < RESTART_THREADS; t++) {
+        tried += results[t].orders_tried;
+        expanded += results[t].expanded;
+        warm += results[t].warm_searches;
+        full += results[t].full_searches;
+        window_expanded += results[t].window_expanded;
+        if (results[t].order_id >= 0 && (best < 0 || better_result(&results[t], &results[best]))) best = t;
+    }
+    results[best].orders_tried = tried;
+    results[best].expanded = expanded;
+    results[best].warm_searches = warm;
+    results[best].full_searches = full;
+    results[best].window_expanded = window_expanded;
+    return results[best];
 }
 
 int main() {
-    memset(reservation_table, false, sizeof(reservation_table));
     setup_grid();
 
     // Customize agent names and positions here
     Agent agents[MAX_AGENTS] = {
-        {{1,1}, {6,6}, {{0}}, 'A', false},
-        {{1,5}, {6,0}, {{0}}, 'B', false},
-        {{5,1}, {0,6}, {{0}}, 'C', false},
-        {{5,5}, {0,0}, {{0}}, 'D', false},
-        {{3,3}, {3,0}, {{0}}, 'E', false}
+        {.start = {1, 1}, .goal = {6, 6}, .name = 'A'},
+        {.start = {1, 5}, .goal = {6, 0}, .name = 'B'},
+        {.start = {5, 1}, .goal = {0, 6}, .name = 'C'},
+        {.start = {5, 5}, .goal = {0, 0}, .name = 'D'},
+        {.start = {3, 3}, .goal = {3, 0}, .name = 'E'}
     };
     int agent_count = 5;
 
-    for (int i = 0; i < agent_count; i++) {
-        if (!whca_star(&agents[i], WINDOW)) {
-            printf("Agent %c could not find a path within window.\n", agents[i].name);
-        }
-        agents[i].finished = false;
-    }
-
-    int max_steps = 0;
-    for (int i = 0; i < agent_count; i++) {
-        if (agents[i].path.length > max_steps) {
-            max_steps = agents[i].path.length;
-        }
+    RestartResult best = run_restarts(agents, agent_count);
+    memcpy(agents, best.agents, sizeof(best.agents));
+    int max_steps = best.makespan + 1;
+    if (max_steps > MAX_PATH) {
+        printf("The run took %d steps; replaying the first %d.\n", best.makespan, MAX_PATH);
+        max_steps = MAX_PATH;
     }
 
     for (int t = 0; t < max_steps; t++) {
@@ -302,6 +867,18 @@ int main() {
         usleep(STEP_DELAY);
     }
 
+    for (int i = 0; i < agent_count; i++) {
+        if (best.stuck[i] > 0) {
+            printf("Agent %c could not find a path within window %d times.\n", agents[i].name, best.stuck[i]);
+        }
+    }
+    printf("Best of %d priority orders: order %d, %d of %d agents home, makespan %d, sum of costs %d.\n",
+        best.orders_tried, best.order_id, best.home, agent_count, best.makespan, best.cost);
+    printf("Reservations: %d bit rows of %d cells and %d edges, %zu bytes per worker.\n",
+        WINDOW + 1, GRID_WIDTH * GRID_HEIGHT, GRID_WIDTH * GRID_HEIGHT * 4, sizeof(ReservationRows));
+    printf("Reverse searches expanded %d cells over %d threads.\n", best.expanded, RESTART_THREADS);
+    printf("Window searches: %d warm-started, %d from scratch, %ld states expanded.\n",
+        best.warm_searches, best.full_searches, best.window_expanded);
     printf("Simulation complete.\n");
     return 0;
 }
@@ -0,0 +1,129 @@
+// Regression test for plan_window on fleets packed so tightly that agents keep failing to find
+// a plan: every window has to end with a fresh, collision-free plan for every agent.
+// Build from the repository root: gcc -O2 -pthread -o boxed_in_test WHCAStar/tests/boxed_in_test.c
+#define main whca_main
+#include "../Whcatemplate.c"
+#undef main
+
+typedef struct {
+    const char *rows[GRID_HEIGHT];
+    int agent_count;
+    Position start[MAX_AGENTS], goal[MAX_AGENTS];
+} Scenario;
+
+// Found by random search; before the fix, planning gave up on some windows and left agents on
+// plans from an earlier window, which ran into each other
+Scenario scenarios[] = {
+    {
+        {
+            "....##.",
+            "##.#..#",
+            "##.#.#.",
+            ".##..##",
+            ".#.#..#",
+            "#..##..",
+            "#....#.",
+        },
+        9,
+        {{5,1}, {5,4}, {2,4}, {6,6}, {2,5}, {5,5}, {4,6}, {4,1}, {3,3}},
+        {{5,1}, {4,6}, {6,0}, {4,2}, {2,4}, {1,5}, {6,2}, {3,3}, {2,1}},
+    },
+    {
+        {
+            "#.#....",
+            ".#....#",
+            ".##.#..",
+            "##...#.",
+            "..##.##",
+            "#.###.#",
+            "...##.#",
+        },
+        9,
+        {{4,1}, {0,2}, {5,6}, {0,6}, {1,6}, {6,2}, {2,6}, {0,1}, {1,4}},
+        {{0,2}, {2,6}, {0,4}, {2,1}, {5,5}, {5,2}, {0,1}, {1,6}, {1,5}},
+    },
+};
+
+// Position of an agent `t` steps into its window plan; shorter plans end by staying put
+Position plan_at(Agent *agent, int t) {
+    return agent->plan.pos[t < agent->plan.length ? t : agent->plan.length - 1];
+}
+
+// Checks the plans of one window: each starts where its agent stands, moves one cell at a time
+// through free cells, and no two agents share a cell or swap places
+int check_window(Agent agents[], int agent_count, int now) {
+    int errors = 0;
+    for (int i = 0; i < agent_count; i++) {
+        Position p = plan_at(&agents[i], 0);
+        if (p.x != agents[i].at.x || p.y != agents[i].at.y) {
+            printf("  t=%d: agent %c plans from (%d,%d) but stands on (%d,%d)\n",
+                now, agents[i].name, p.x, p.y, agents[i].at.x, agents[i].at.y);
+            errors++;
+        }
+        for (int t = 1; t <= WINDOW; t++) {
+            Position a = plan_at(&agents[i], t - 1), b = plan_at(&agents[i], t);
+            if (manhattan(a, b) > 1 || !is_valid(b.x, b.y)) {
+                printf("  t=%d: agent %c jumps from (%d,%d) to (%d,%d)\n", now + t, agents[i].name, a.x, a.y, b.x, b.y);
+                errors++;
+            }
+        }
+    }
+    for (int t = 0; t <= WINDOW; t++) {
+        for (int i = 0; i < agent_count; i++) {
+            for (int j = i + 1; j < agent_count; j++) {
+                Position a = plan_at(&agents[i], t), b = plan_at(&agents[j], t);
+                if (a.x == b.x && a.y == b.y) {
+                    printf("  t=%d: agents %c and %c both on (%d,%d)\n", now + t, agents[i].name, agents[j].name, a.x, a.y);
+                    errors++;
+                }
+                if (t > 0) {
+                    Position pa = plan_at(&agents[i], t - 1), pb = plan_at(&agents[j], t - 1);
+                    if (pa.x == b.x && pa.y == b.y && pb.x == a.x && pb.y == a.y && manhattan(a, b) == 1) {
+                        printf("  t=%d: agents %c and %c swap places\n", now + t, agents[i].name, agents[j].name);
+                        errors++;
+                    }
+                }
+            }
+        }
+    }
+    return errors;
+}
+
+// Runs the scenario window by window, like simulate, checking every window's plans
+int run_scenario(Scenario *s) {
+    for (int y = 0; y < GRID_HEIGHT; y++) memcpy(map[y], s->rows[y], GRID_WIDTH);
+    setup_grid();
+
+    Agent agents[MAX_AGENTS];
+    int priority[MAX_AGENTS];
+    memset(agents, 0, sizeof(agents));
+    for (int i = 0; i < s->agent_count; i++) {
+        agents[i].start = agents[i].at = s->start[i];
+        agents[i].goal = s->goal[i];
+        agents[i].name = 'A' + i;
+        priority[i] = i;
+        init_reverse_search(i, agents[i].goal, agents[i].start);
+    }
+    memset(goal_hold, 0, sizeof(goal_hold));
+    memset(stuck_windows, 0, sizeof(stuck_windows));
+
+    int errors = 0, round = 0;
+    for (int now = 0; now < 200 && errors == 0; now += REPLAN_INTERVAL) {
+        plan_window(agents, s->agent_count, priority, now, round++);
+        errors += check_window(agents, s->agent_count, now);
+        for (int i = 0; i < s->agent_count; i++) agents[i].at = plan_at(&agents[i], REPLAN_INTERVAL);
+    }
+    return errors;
+}
+
+int main() {
+    init_search_buffers();
+    int failed = 0, count = sizeof(scenarios) / sizeof(scenarios[0]);
+    for (int k = 0; k < count; k++) {
+        int errors = run_scenario(&scenarios[k]);
+        printf("Scenario %d: %s\n", k + 1, errors ? "FAILED" : "ok");
+        if (errors) failed++;
+    }
+    free_search_buffers();
+    return failed ? 1 : 0;
+}
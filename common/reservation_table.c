@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "reservation_table.h"
+
+static void rt_alloc_slots(ReservationTable *rt, int capacity) {
+    rt->slots = malloc(capacity * sizeof(ReservationSlot));
+    if (!rt->slots) {
+        fprintf(stderr, "Out of memory for reservations.\n");
+        exit(1);
+    }
+    for (int i = 0; i < capacity; i++) rt->slots[i].key = RESERVATION_EMPTY;
+    rt->capacity = capacity;
+    rt->used = 0;
+}
+
+void rt_init(ReservationTable *rt, int cells, int horizon) {
+    memset(rt, 0, sizeof(*rt));
+    rt->cells = cells;
+    rt->horizon = horizon;
+    rt->dense = (long long)cells * horizon <= RESERVATION_SMALL;
+    if (rt->dense) {
+        rt->owners = calloc((size_t)cells * horizon, 1);
+        if (!rt->owners) {
+            fprintf(stderr, "Out of memory for reservations.\n");
+            exit(1);
+        }
+    } else {
+        rt_alloc_slots(rt, 1024);
+    }
+}
+
+void rt_free(ReservationTable *rt) {
+    free(rt->owners);
+    free(rt->slots);
+    rt->owners = NULL;
+    rt->slots = NULL;
+}
+
+void rt_clear(ReservationTable *rt) {
+    if (rt->dense) {
+        memset(rt->owners, 0, (size_t)rt->cells * rt->horizon);
+    } else {
+        for (int i = 0; i < rt->capacity; i++) rt->slots[i].key = RESERVATION_EMPTY;
+        rt->used = 0;
+    }
+    rt->count = 0;
+}
+
+// Slot holding key, or the empty slot where it would go
+static int rt_find(ReservationTable *rt, uint64_t key) {
+    uint64_t h = key * 0x9E3779B97F4A7C15ULL;
+    int i = (int)(h >> 32) & (rt->capacity - 1);
+    rt->lookups++;
+    while (rt->slots[i].key != key && rt->slots[i].key != RESERVATION_EMPTY) {
+        i = (i + 1) & (rt->capacity - 1);
+        rt->probes++;
+    }
+    return i;
+}
+
+// Inside the cells and times the table was made for
+static bool rt_inside(ReservationTable *rt, int cell, int time) {
+    return cell >= 0 && cell < rt->cells && time >= 0 && time < rt->horizon;
+}
+
+int rt_get(ReservationTable *rt, int cell, int time) {
+    if (!rt_inside(rt, cell, time)) return RESERVATION_OUTSIDE;
+    if (rt->dense) return rt->owners[(size_t)time * rt->cells + cell];
+    int i = rt_find(rt, (uint64_t)cell << 32 | (uint32_t)time);
+    return rt->slots[i].key == RESERVATION_EMPTY ? 0 : rt->slots[i].owner;
+}
+
+static void rt_make_dense(ReservationTable *rt) {
+    rt->owners = calloc((size_t)rt->cells * rt->horizon, 1);
+    if (!rt->owners) {
+        fprintf(stderr, "Out of memory for reservations.\n");
+        exit(1);
+    }
+    for (int i = 0; i < rt->capacity; i++) {
+        ReservationSlot *s = &rt->slots[i];
+        if (s->key != RESERVATION_EMPTY && s->owner != 0) {
+            rt->owners[(size_t)(uint32_t)s->key * rt->cells + (int)(s->key >> 32)] = s->owner;
+        }
+    }
+    free(rt->slots);
+    rt->slots = NULL;
+    rt->capacity = rt->used = 0;
+    rt->dense = true;
+}
+
+// Rehash without the released slots. Only grow when they are not what fills the table:
+// if fewer than half the used slots are still reserved, the same capacity is enough.
+static void rt_rehash(ReservationTable *rt) {
+    ReservationSlot *old = rt->slots;
+    int old_capacity = rt->capacity;
+    rt_alloc_slots(rt, rt->count * 2 < rt->used ? old_capacity : old_capacity * 2);
+    for (int i = 0; i < old_capacity; i++) {
+        if (old[i].key == RESERVATION_EMPTY || old[i].owner == 0) continue;
+        int j = rt_find(rt, old[i].key);
+        rt->slots[j] = old[i];
+        rt->used++;
+    }
+    free(old);
+}
+
+bool rt_set(ReservationTable *rt, int cell, int time, int owner) {
+    if (!rt_inside(rt, cell, time)) return false;
+    if (rt->dense) {
+        unsigned char *o = &rt->owners[(size_t)time * rt->cells + cell];
+        rt->count += (owner != 0) - (*o != 0);
+        *o = owner;
+        return true;
+    }
+    uint64_t key = (uint64_t)cell << 32 | (uint32_t)time;
+    int i = rt_find(rt, key);
+    if (rt->slots[i].key == RESERVATION_EMPTY) {
+        if (owner == 0) return true;
+        rt->slots[i].key = key;
+        rt->slots[i].owner = 0;
+        rt->used++;
+    }
+    rt->count += (owner != 0) - (rt->slots[i].owner != 0);
+    rt->slots[i].owner = owner;
+
+    if (rt->count * RESERVATION_DENSE_FILL > (long long)rt->cells * rt->horizon) {
+        rt_make_dense(rt);
+    } else if (rt->used * 2 >= rt->capacity) {
+        rt_rehash(rt);
+    }
+    return true;
+}
+
+size_t rt_bytes(ReservationTable *rt) {
+    return rt->dense ? (size_t)rt->cells * rt->horizon : rt->capacity * sizeof(ReservationSlot);
+}
+
+void rt_report(ReservationTable *rt, const char *name) {
+    printf("%s: %s, %lld of %lld states reserved, %zu bytes", name, rt->dense ? "dense" : "sparse",
+        rt->count, (long long)rt->cells * rt->horizon, rt_bytes(rt));
+    if (rt->lookups > 0) printf(", %.2f probes per lookup", 1.0 + (double)rt->probes / rt->lookups);
+    printf("\n");
+}
@@ -0,0 +1,52 @@
+// Space-time reservations behind one interface: a dense array with one owner byte per
+// (cell, time), or an open-addressing hash keyed by cell << 32 | time when few states are set.
+// A table starts sparse unless it is small, and turns dense once its fill ratio makes the
+// array the cheaper of the two. Owner 0 means free. Times run from 0 to horizon - 1: a state
+// outside them reads as reserved by RESERVATION_OUTSIDE and cannot be set, so a planner that
+// runs past the horizon finds no path instead of indexing out of bounds.
+// Only WHCA* plans unbounded runs, in its own windowed table. ST-SPF and STMS plan whole
+// paths in this one, so their runs stay capped at MAX_TIME and MAX_PATH steps.
+// Shared by ST-SPF and STMS; compile common/reservation_table.c alongside either program.
+#ifndef RESERVATION_TABLE_H
+#define RESERVATION_TABLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef RESERVATION_DENSE_FILL
+#define RESERVATION_DENSE_FILL 32 // Go dense once more than 1 state in this many is reserved
+#endif
+#ifndef RESERVATION_SMALL
+#define RESERVATION_SMALL 65536 // Tables with at most this many states are dense from the start
+#endif
+#define RESERVATION_EMPTY UINT64_MAX
+#define RESERVATION_OUTSIDE -1 // Owner of states outside the table, never a caller's owner
+
+typedef struct {
+    uint64_t key;
+    int owner;
+} ReservationSlot;
+
+typedef struct {
+    int cells, horizon;
+    bool dense;
+    unsigned char *owners; // Dense backend, indexed by time * cells + cell
+    ReservationSlot *slots; // Sparse backend, linear probing over a power-of-two capacity
+    int capacity, used; // Slots holding a key, including released ones
+    long long count; // Reserved states
+    long long lookups, probes; // Probe statistics of the sparse backend
+} ReservationTable;
+
+void rt_init(ReservationTable *rt, int cells, int horizon);
+void rt_free(ReservationTable *rt);
+// Drop every reservation
+void rt_clear(ReservationTable *rt);
+// Owner of (cell, time), 0 if free, RESERVATION_OUTSIDE outside the table
+int rt_get(ReservationTable *rt, int cell, int time);
+// Reserve (cell, time) for owner, or release it with owner 0. False outside the table.
+bool rt_set(ReservationTable *rt, int cell, int time, int owner);
+size_t rt_bytes(ReservationTable *rt);
+void rt_report(ReservationTable *rt, const char *name);
+
+#endif